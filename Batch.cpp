@@ -0,0 +1,87 @@
+#include <Batch.h>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace potato {
+
+size_t BatchMoves::size() const
+{
+  return mOffsets.empty() ? 0 : mOffsets.size() - 1;
+}
+
+std::span<const Move> BatchMoves::moves(size_t i) const
+{
+  return std::span<const Move>(mMoves.data() + mOffsets[i],
+                               mMoves.data() + mOffsets[i + 1]);
+}
+
+static size_t numThreads(size_t requested, size_t nPositions)
+{
+  size_t n = requested == 0 ? std::thread::hardware_concurrency() : requested;
+  return std::clamp<size_t>(n, 1, std::max<size_t>(nPositions, 1));
+}
+
+/**
+ * @brief Split the range [0, n) into nThreads contiguous chunks and call fn(chunk, begin,
+ * end) for each of them on its own thread. The first chunk runs on the calling thread.
+ */
+template<typename Fn>
+static void parallelChunks(size_t n, size_t nThreads, Fn&& fn)
+{
+  auto chunkBegin = [n, nThreads](size_t c) { return n * c / nThreads; };
+  std::vector<std::thread> threads;
+  threads.reserve(nThreads - 1);
+  for (size_t c = 1; c < nThreads; ++c) {
+    threads.emplace_back(fn, c, chunkBegin(c), chunkBegin(c + 1));
+  }
+  fn(size_t(0), chunkBegin(0), chunkBegin(1));
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+void generateMoves(std::span<const Position> positions, BatchMoves& out, size_t nThreads)
+{
+  size_t n = positions.size();
+  nThreads = numThreads(nThreads, n);
+  out.mOffsets.assign(n + 1, 0);
+  std::vector<std::vector<Move>> buffers(nThreads);
+  parallelChunks(n, nThreads, [&](size_t chunk, size_t begin, size_t end) {
+    auto&    buf = buffers[chunk];
+    MoveList moves;
+    buf.reserve((end - begin) * 40);
+    for (size_t i = begin; i < end; ++i) {
+      generateMoves(positions[i], moves);
+      buf.insert(buf.end(), moves.begin(), moves.end());
+      out.mOffsets[i + 1] = moves.size();
+    }
+  });
+  for (size_t i = 0; i < n; ++i) {
+    out.mOffsets[i + 1] += out.mOffsets[i];
+  }
+  out.mMoves.resize(out.mOffsets[n]);
+  parallelChunks(n, nThreads, [&](size_t chunk, size_t begin, size_t) {
+    std::copy(buffers[chunk].begin(),
+              buffers[chunk].end(),
+              out.mMoves.begin() + ptrdiff_t(out.mOffsets[begin]));
+    std::vector<Move>().swap(buffers[chunk]);
+  });
+}
+
+void countMoves(std::span<const Position> positions,
+                std::span<size_t>         counts,
+                size_t                    nThreads)
+{
+  if (counts.size() != positions.size()) {
+    throw std::logic_error("The counts must be as long as the positions.");
+  }
+  size_t n = positions.size();
+  parallelChunks(n, numThreads(nThreads, n), [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      counts[i] = countMoves(positions[i]);
+    }
+  });
+}
+
+}  // namespace potato
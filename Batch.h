@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Move.h>
+#include <span>
+#include <vector>
+
+namespace potato {
+
+/**
+ * @brief Legal moves of a batch of positions, in one flat buffer. The moves of the i-th
+ * position are mMoves[mOffsets[i]] up to mMoves[mOffsets[i + 1]].
+ */
+struct BatchMoves
+{
+  std::vector<Move>   mMoves;
+  std::vector<size_t> mOffsets;
+
+  /**
+   * @brief Number of positions in the batch.
+   */
+  size_t                size() const;
+  std::span<const Move> moves(size_t i) const;
+};
+
+/**
+ * @brief Generate the legal moves of many positions. The positions are split into
+ * contiguous chunks, one per thread. Each thread generates into a MoveList on its own
+ * stack, so the list stays in cache, and collects its chunk in a buffer of its own. The
+ * buffers are then copied into the flat output.
+ *
+ * @param positions The positions. These are only read, so the same span may be shared by
+ * several batches.
+ * @param out Written with the moves and offsets. Previous contents will be erased.
+ * @param nThreads Number of threads to use. Zero uses all hardware threads.
+ */
+void generateMoves(std::span<const Position> positions,
+                   BatchMoves&               out,
+                   size_t                    nThreads = 0);
+/**
+ * @brief Count the legal moves of many positions, splitting them across threads like
+ * the batched generateMoves.
+ *
+ * @param counts Written with the number of legal moves of each position. It must be as
+ * long as positions.
+ */
+void countMoves(std::span<const Position> positions,
+                std::span<size_t>         counts,
+                size_t                    nThreads = 0);
+
+}  // namespace potato
@@ -1,9 +1,12 @@
 #include <ArgVSplit.h>
+#include <Batch.h>
 #include <Command.h>
 #include <Position.h>
 #include <View.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <argparse/argparse.hpp>
+#include <chrono>
+#include <fstream>
 #include <regex>
 #include <string>
 #include <string_view>
@@ -103,8 +106,11 @@ void loadFen(int argc, const char** argv)
     .help("The FEN string of the position to be loaded.")
     .required();
   parser.parse_args(argc, argv);
-  auto fen          = parser.get<std::string>("fenstr");
-  currentPosition() = Position::fromFen(fen);
+  auto     fen = parser.get<std::string>("fenstr");
+  Position p   = Position::fromFen(fen);
+  // Nothing can revert to the previous position anymore, so drop its undo records.
+  currentPosition().freezeState();
+  currentPosition() = p;
   // This will update the view only if the view is actually open.
   view::update();
 }
@@ -116,9 +122,109 @@ void perft(int argc, const char** argv)
     .help("The depth to traverse when counting moves.")
     .required()
     .scan<'i', int>();
+  parser.add_argument("--pseudo-legal")
+    .help("Generate pseudo-legal moves and check their legality lazily.")
+    .default_value(false)
+    .implicit_value(true);
+  parser.add_argument("--copy-make")
+    .help("Copy the position for each move instead of committing and reverting it.")
+    .default_value(false)
+    .implicit_value(true);
   parser.parse_args(argc, argv);
-  int depth = parser.get<int>("depth");
-  potato::perft(currentPosition(), depth);
+  int  depth       = parser.get<int>("depth");
+  bool pseudoLegal = parser.get<bool>("--pseudo-legal");
+  bool copyMake    = parser.get<bool>("--copy-make");
+  potato::perft(currentPosition(), depth, pseudoLegal, copyMake);
+}
+
+void batch(int argc, const char** argv)
+{
+  argparse::ArgumentParser parser("batch");
+  parser.add_argument("path")
+    .help("A file with one FEN string per line.")
+    .required();
+  parser.add_argument("--threads")
+    .help("Number of threads to use. Zero uses all hardware threads.")
+    .default_value(0)
+    .scan<'i', int>();
+  parser.add_argument("--count")
+    .help("Only count the legal moves, instead of generating them.")
+    .default_value(false)
+    .implicit_value(true);
+  parser.parse_args(argc, argv);
+  std::ifstream file(parser.get<std::string>("path"));
+  if (!file) {
+    throw std::runtime_error("Cannot open the FEN file");
+  }
+  std::vector<Position> positions;
+  std::string           line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      positions.push_back(Position::fromFen(line));
+    }
+  }
+  size_t nThreads = size_t(std::max(parser.get<int>("--threads"), 0));
+  size_t total    = 0;
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  if (parser.get<bool>("--count")) {
+    std::vector<size_t> counts(positions.size());
+    countMoves(positions, counts, nThreads);
+    for (size_t c : counts) {
+      total += c;
+    }
+  }
+  else {
+    BatchMoves moves;
+    generateMoves(positions, moves, nThreads);
+    total = moves.mMoves.size();
+  }
+  double seconds = duration<double>(steady_clock::now() - start).count();
+  std::cout << "Positions: " << positions.size() << std::endl
+            << "Moves: " << total << std::endl
+            << "Positions per second: " << size_t(double(positions.size()) / seconds)
+            << std::endl;
+}
+
+void fenBench(int argc, const char** argv)
+{
+  argparse::ArgumentParser parser("fenbench");
+  parser.add_argument("path")
+    .help("A file with one FEN string per line.")
+    .required();
+  parser.parse_args(argc, argv);
+  std::ifstream file(parser.get<std::string>("path"));
+  if (!file) {
+    throw std::runtime_error("Cannot open the FEN file");
+  }
+  std::vector<std::string> lines;
+  std::string              line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+  using namespace std::chrono;
+  std::vector<Position> positions;
+  positions.reserve(lines.size());
+  auto start = steady_clock::now();
+  for (const auto& fen : lines) {
+    positions.push_back(Position::fromFen(fen));
+  }
+  double parseSeconds = duration<double>(steady_clock::now() - start).count();
+  size_t written      = 0;
+  start               = steady_clock::now();
+  for (const auto& p : positions) {
+    Position::FenBuffer buf;
+    written += p.fen(buf).size();
+  }
+  double writeSeconds = duration<double>(steady_clock::now() - start).count();
+  std::cout << "FENs: " << lines.size() << std::endl
+            << "Bytes written: " << written << std::endl
+            << "Parsed per second: " << size_t(double(lines.size()) / parseSeconds)
+            << std::endl
+            << "Written per second: " << size_t(double(lines.size()) / writeSeconds)
+            << std::endl;
 }
 
 void show(int argc, const char** argv)
@@ -132,7 +238,9 @@ void show(int argc, const char** argv)
 void init()
 {
   cmdFuncMap().emplace("fen", funcs::loadFen);
+  cmdFuncMap().emplace("fenbench", funcs::fenBench);
   cmdFuncMap().emplace("perft", funcs::perft);
+  cmdFuncMap().emplace("batch", funcs::batch);
   cmdFuncMap().emplace("show", funcs::show);
 }
 
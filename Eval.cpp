@@ -45,23 +45,113 @@ static int evalMove(Move m, const Position& position)
   return score;
 }
 
-static void sortMoves(MoveList& moves, const Position& position)
+static int mvvlva(Move m, const Position& position)
 {
-  StaticVector<std::pair<Move, int>, MoveList::Size> mpairs;
-  std::transform(moves.begin(), moves.end(), std::back_inserter(mpairs), [&](Move m) {
-    return std::make_pair(m, evalMove(m, position));
-  });
-  std::sort(mpairs.begin(),
-            mpairs.end(),
-            [](const std::pair<Move, int>& a, const std::pair<Move, int>& b) {
-              return a.second > b.second;
-            });
-  std::transform(
-    mpairs.begin(), mpairs.end(), moves.begin(), [](const std::pair<Move, int>& mpair) {
-      return mpair.first;
-    });
+  // Most valuable victim first, and then the least valuable attacker.
+  Piece victim = (m.type() == ENPASSANT) ? PWN | WHT : position.piece(m.to());
+  return std::abs(MaterialValue[victim]) * 8 - type(position.piece(m.from()));
 }
 
+// Added to the score of a capture that loses material.
+static constexpr int LosingCapture = -1024;
+
+MovePicker::MovePicker(const Position& p, Move hashMove)
+    : mPosition(p)
+    , mHashMove(hashMove)
+{}
+
+template<GenType Type>
+void MovePicker::generate()
+{
+#ifdef POTATO_LAZY_LEGALITY
+  mInCheck = generatePseudoLegalMoves<Type>(mPosition, mMoves);
+#else
+  mInCheck = generateMoves<Type>(mPosition, mMoves);
+#endif
+  mCurrent = 0;
+  for (size_t i = 0; i < mMoves.size(); ++i) {
+    mScores[i] = Type == GenType::CAPTURES ? mvvlva(mMoves[i], mPosition)
+                                           : evalMove(mMoves[i], mPosition);
+  }
+}
+
+bool MovePicker::pick(Move& m)
+{
+  while (mCurrent < mMoves.size()) {
+    // Partial selection sort. Only the moves that are actually tried get sorted.
+    size_t best = mCurrent;
+    for (size_t i = mCurrent + 1; i < mMoves.size(); ++i) {
+      if (mScores[i] > mScores[best]) {
+        best = i;
+      }
+    }
+    std::swap(mMoves[mCurrent], mMoves[best]);
+    std::swap(mScores[mCurrent], mScores[best]);
+    // SEE is only computed for the captures that are actually tried. The ones that lose
+    // material go after all the others. MVV-LVA scores are always positive.
+    if (mStage == Stage::CAPTURES && mScores[mCurrent] >= 0 &&
+        !seeGE(mPosition, mMoves[mCurrent], 0)) {
+      mScores[mCurrent] += LosingCapture;
+      continue;
+    }
+    m = mMoves[mCurrent++];
+#ifdef POTATO_LAZY_LEGALITY
+    // Only the moves that are actually tried are checked for legality.
+    if (m != mHashMove && isLegal(mPosition, m, mInCheck)) {
+      return true;
+    }
+#else
+    if (m != mHashMove) {  // Hash move was already tried.
+      return true;
+    }
+#endif
+  }
+  return false;
+}
+
+bool MovePicker::next(Move& m)
+{
+  switch (mStage) {
+  case Stage::HASH:
+    mStage = Stage::GEN_CAPTURES;
+    if (isPseudoLegal(mPosition, mHashMove) && isLegal(mPosition, mHashMove)) {
+      m = mHashMove;
+      return true;
+    }
+    [[fallthrough]];
+  case Stage::GEN_CAPTURES:
+    generate<GenType::CAPTURES>();
+    mStage = Stage::CAPTURES;
+    [[fallthrough]];
+  case Stage::CAPTURES:
+    if (pick(m)) {
+      return true;
+    }
+    mStage = Stage::GEN_QUIETS;
+    [[fallthrough]];
+  case Stage::GEN_QUIETS:
+    generate<GenType::QUIETS>();
+    mStage = Stage::QUIETS;
+    [[fallthrough]];
+  case Stage::QUIETS:
+    if (pick(m)) {
+      return true;
+    }
+    mStage = Stage::DONE;
+    [[fallthrough]];
+  case Stage::DONE:
+  default:
+    return false;
+  }
+}
+
+bool MovePicker::inCheck() const
+{
+  return mInCheck;
+}
+
+static constexpr int SearchDepth = 8;
+
 int maximize(Position& position,
              int       depth,
              Response& move,
@@ -74,14 +164,18 @@ int minimize(Position& position,
              int       alpha = INT_MIN,
              int       beta  = INT_MAX)
 {
+  if (depth < SearchDepth && position.isDraw(SearchDepth - depth)) {
+    return 0;
+  }
   if (depth == 0) {
     return staticEval(position);
   }
-  MoveList moves;
-  bool     inCheck = generateMoves(position, moves);
-  sortMoves(moves, position);
-  int best = INT_MAX;
-  for (Move m : moves) {
+  MovePicker picker(position);
+  Move       m;
+  bool       anyMoves = false;
+  int        best     = INT_MAX;
+  while (picker.next(m)) {
+    anyMoves = true;
     m.commit(position);
     Response next;
     int      eval = maximize(position, depth - 1, next, alpha, beta);
@@ -95,8 +189,8 @@ int minimize(Position& position,
       break;
     }
   }
-  if (moves.empty()) {
-    if (inCheck) {
+  if (!anyMoves) {
+    if (picker.inCheck()) {
       move = {std::nullopt, Conclusion::CHECKMATE};
       return 100;
     }
@@ -110,14 +204,18 @@ int minimize(Position& position,
 
 int maximize(Position& position, int depth, Response& move, int alpha, int beta)
 {
+  if (depth < SearchDepth && position.isDraw(SearchDepth - depth)) {
+    return 0;
+  }
   if (depth == 0) {
     return staticEval(position);
   }
-  MoveList moves;
-  bool     inCheck = generateMoves(position, moves);
-  sortMoves(moves, position);
-  int best = INT_MIN;
-  for (Move m : moves) {
+  MovePicker picker(position);
+  Move       m;
+  bool       anyMoves = false;
+  int        best     = INT_MIN;
+  while (picker.next(m)) {
+    anyMoves = true;
     m.commit(position);
     Response next;
     int      eval = minimize(position, depth - 1, next, alpha, beta);
@@ -131,8 +229,8 @@ int maximize(Position& position, int depth, Response& move, int alpha, int beta)
       break;
     }
   }
-  if (moves.empty()) {
-    if (inCheck) {
+  if (!anyMoves) {
+    if (picker.inCheck()) {
       move = {std::nullopt, Conclusion::CHECKMATE};
       return -100;
     }
@@ -146,13 +244,12 @@ int maximize(Position& position, int depth, Response& move, int alpha, int beta)
 
 Response minimax(Position& position, int alpha = INT_MIN, int beta = INT_MAX)
 {
-  Response             move;
-  static constexpr int Depth = 8;
+  Response move;
   if (position.turn() == WHT) {
-    maximize(position, Depth, move, alpha, beta);
+    maximize(position, SearchDepth, move, alpha, beta);
   }
   else {
-    minimize(position, Depth, move, alpha, beta);
+    minimize(position, SearchDepth, move, alpha, beta);
   }
   return move;
 }
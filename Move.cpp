@@ -1,35 +1,42 @@
 #include <Move.h>
+#include <algorithm>
 #include <bit>
+#include <chrono>
 #include <iostream>
 
+#if (defined(POTATO_PEXT_SLIDERS) || defined(POTATO_AVX2)) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace potato {
 
 Move::Move(MoveType type, int from, int to)
-    : mType(type)
-    , mFrom(uint8_t(from))
-    , mTo(uint8_t(to))
+    : mData(uint16_t(from | (to << 6) | (type << 12)))
 {}
 
 void Move::assign(MoveType type, int from, int to)
 {
-  mType = type;
-  mFrom = uint8_t(from);
-  mTo   = uint8_t(to);
+  mData = uint16_t(from | (to << 6) | (type << 12));
 }
 
 MoveType Move::type() const
 {
-  return mType;
+  return MoveType(mData >> 12);
 }
 
 int Move::from() const
 {
-  return int(mFrom);
+  return mData & 0x3f;
 }
 
 int Move::to() const
 {
-  return int(mTo);
+  return (mData >> 6) & 0x3f;
+}
+
+bool Move::isCapture(const Position& p) const
+{
+  return p.piece(to()) != NONE || type() == ENPASSANT;
 }
 
 template<Color Player>
@@ -53,8 +60,8 @@ void commitMv(Position& p, MoveType mtype, int from, int to)
   static constexpr Direction Up               = RelativeDir<N, Player>;
   static constexpr int       HomeRank         = RelativeRank<Player, 0>;
   static constexpr int       EnemyHomeRank    = RelativeRank<Player, 7>;
-  bool                       isCapture        = mtype & CAPTURE;
-  mtype                                       = MoveType(mtype & ~CAPTURE);
+  bool                       isCapture        = p.piece(to) != NONE;
+  p.setCapturedPiece(p.piece(to));
   if (isCapture) {
     if (p.piece(to) == (Enemy | ROK)) {
       if (to == EnemyHomeRank * 8) {
@@ -64,7 +71,6 @@ void commitMv(Position& p, MoveType mtype, int from, int to)
         p.revokeCastlingRights(EnemyCastleShort);
       }
     }
-    p.pushCapture(p.piece(to));
   }
   switch (mtype) {
   case MV_KNG:
@@ -148,10 +154,8 @@ void commitMv(Position& p, MoveType mtype, int from, int to)
 template<Color Player>
 void revertMv(Position& p, MoveType mtype, int from, int to)
 {
-  static constexpr Color Enemy     = Player == WHT ? BLK : WHT;
-  static constexpr int   HomeRank  = RelativeRank<Player, 0>;
-  bool                   isCapture = mtype & CAPTURE;
-  mtype                            = MoveType(mtype & ~CAPTURE);
+  static constexpr Color Enemy    = Player == WHT ? BLK : WHT;
+  static constexpr int   HomeRank = RelativeRank<Player, 0>;
   switch (mtype) {
   case MV_KNG:
   case MV_ROK:
@@ -185,33 +189,46 @@ void revertMv(Position& p, MoveType mtype, int from, int to)
     p.move(to, from);
     break;
   }
-  if (isCapture) {
-    p.put(to, p.popCapture());
+  if (p.capturedPiece() != NONE) {
+    p.put(to, p.capturedPiece());
   }
 }
 
-void Move::commit(Position& p) const
+static void commitInPlace(Position& p, MoveType type, int from, int to)
 {
-  p.pushState();
   p.unsetEnpassantSq();
   if (p.turn() == WHT) {
-    commitMv<WHT>(p, mType, from(), to());
+    commitMv<WHT>(p, type, from, to);
   }
   else if (p.turn() == BLK) {
-    commitMv<BLK>(p, mType, from(), to());
+    commitMv<BLK>(p, type, from, to);
     p.incrementMoveCounter();
   }
   p.switchTurn();
 }
 
+void Move::commit(Position& p) const
+{
+  p.pushState();
+  commitInPlace(p, type(), from(), to());
+}
+
+Position Move::commitCopy(const Position& p) const
+{
+  Position next = p;
+  next.detachHistory();
+  commitInPlace(next, type(), from(), to());
+  return next;
+}
+
 void Move::revert(Position& p) const
 {
   p.switchTurn();
   if (p.turn() == WHT) {
-    revertMv<WHT>(p, mType, from(), to());
+    revertMv<WHT>(p, type(), from(), to());
   }
   else if (p.turn() == BLK) {
-    revertMv<BLK>(p, mType, from(), to());
+    revertMv<BLK>(p, type(), from(), to());
   }
   p.popState();
 }
@@ -220,7 +237,7 @@ std::string Move::algebraic() const
 {
   std::string out = std::string(SquareCoord[from()]);
   out += SquareCoord[to()];
-  switch (type() & ~CAPTURE) {
+  switch (type()) {
   case PRM_HRS:
   case PRC_HRS:
     out.push_back('n');
@@ -243,24 +260,78 @@ std::string Move::algebraic() const
   return out;
 }
 
-bool Move::operator==(const Move& other)
+bool Move::operator==(const Move& other) const
 {
-  return mType == other.mType && mFrom == other.mFrom && mTo == other.mTo;
+  return mData == other.mData;
 }
 
-bool Move::operator!=(const Move& other)
+bool Move::operator!=(const Move& other) const
 {
   return !(*this == other);
 }
 
-void MoveList::append(MoveType type, int from, int to, bool isCapture)
+void MoveList::append(MoveType type, int from, int to)
 {
-  if (isCapture) {
-    type = type | CAPTURE;
-  }
   (mEnd++)->assign(type, from, to);
 }
 
+void MoveList::addMoves(MoveType type, int from, BitBoard targets)
+{
+  while (targets) {
+    append(type, from, pop(targets));
+  }
+}
+
+void MoveList::addPawnMoves(MoveType type, int offset, BitBoard targets)
+{
+  while (targets) {
+    int to = pop(targets);
+    append(type, to - offset, to);
+  }
+}
+
+void MoveList::addPromotions(MoveType knight, int offset, BitBoard targets)
+{
+  while (targets) {
+    int to   = pop(targets);
+    int from = to - offset;
+    append(knight, from, to);
+    append(MoveType(knight + 1), from, to);
+    append(MoveType(knight + 2), from, to);
+    append(MoveType(knight + 3), from, to);
+  }
+}
+
+void MoveCounter::clear()
+{
+  mCount = 0;
+}
+
+size_t MoveCounter::size() const
+{
+  return mCount;
+}
+
+void MoveCounter::append(MoveType, int, int)
+{
+  ++mCount;
+}
+
+void MoveCounter::addMoves(MoveType, int, BitBoard targets)
+{
+  mCount += size_t(std::popcount(targets));
+}
+
+void MoveCounter::addPawnMoves(MoveType, int, BitBoard targets)
+{
+  mCount += size_t(std::popcount(targets));
+}
+
+void MoveCounter::addPromotions(MoveType, int, BitBoard targets)
+{
+  mCount += 4 * size_t(std::popcount(targets));
+}
+
 int pop(BitBoard& b)
 {
   int shift = std::countr_zero(b);
@@ -273,46 +344,159 @@ int lsb(BitBoard b)
   return std::countr_zero(b);
 }
 
-static constexpr std::array<uint64_t, (1 << 16)> reversed16()
+#ifdef POTATO_MAGIC_SLIDERS
+
+static BitBoard portableBishopMoves(int sq, BitBoard blockers)
+{
+  // Fancy magic bitboards, with the tables generated by genTables.py.
+  return SliderAttacks[BishopOffsets[sq] +
+                       (((blockers & BishopMasks[sq]) * BishopMagics[sq]) >>
+                        BishopShifts[sq])];
+}
+
+static BitBoard portableRookMoves(int sq, BitBoard blockers)
 {
-  std::array<uint64_t, (1 << 16)> out;
-  for (size_t i = 0; i < out.size(); ++i) {
-    uint16_t v = uint16_t(i);
-    v      = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);  // swap even and odd bits
-    v      = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);  // swap consecutive pairs
-    v      = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);  // swap nibbles
-    v      = ((v >> 8) & 0x00FF00FF) | ((v & 0x00FF00FF) << 8);  // swap bytes
-    out[i] = uint64_t(v);
+  return SliderAttacks[RookOffsets[sq] +
+                       (((blockers & RookMasks[sq]) * RookMagics[sq]) >> RookShifts[sq])];
+}
+
+#else
+
+static constexpr std::array<std::array<uint8_t, 8>, 64> firstRankAttacks()
+{
+  // Indexed by the 6 inner bits of the rank occupancy, and then the file.
+  std::array<std::array<uint8_t, 8>, 64> out {};
+  for (int occ = 0; occ < 64; ++occ) {
+    int blockers = occ << 1;
+    for (int file = 0; file < 8; ++file) {
+      uint8_t attacks = 0;
+      for (int f = file + 1; f < 8; ++f) {
+        attacks |= uint8_t(1 << f);
+        if (blockers & (1 << f)) {
+          break;
+        }
+      }
+      for (int f = file - 1; f > -1; --f) {
+        attacks |= uint8_t(1 << f);
+        if (blockers & (1 << f)) {
+          break;
+        }
+      }
+      out[occ][file] = attacks;
+    }
   }
   return out;
 }
 
-BitBoard reversed(BitBoard b)
+static BitBoard sliderMoves(int sq, BitBoard blockers, BitBoard line)
 {
-  static constexpr std::array<uint64_t, (1 << 16)> sReversed16 = reversed16();
-  return (sReversed16[0xffff & b] << 48) | (sReversed16[0xffff & (b >> 16)] << 32) |
-         (sReversed16[0xffff & (b >> 32)] << 16) | (sReversed16[0xffff & (b >> 48)]);
+  // Hyperbola quintessence, using a byte swap to reverse the board. This only works for
+  // lines with at most one square per rank, i.e. files and diagonals. The slider's own
+  // square is taken out of the line, so the tables can be passed as they are.
+  BitBoard pc      = OneHot[sq];
+  BitBoard mask    = line & ~pc;
+  BitBoard forward = blockers & mask;
+  BitBoard reverse = __builtin_bswap64(forward);
+  forward -= pc;
+  reverse -= __builtin_bswap64(pc);
+  return (forward ^ __builtin_bswap64(reverse)) & mask;
 }
 
-BitBoard sliderMoves(int sq, BitBoard blockers, BitBoard mask)
+static BitBoard rankMoves(int sq, BitBoard blockers)
 {
-  // Use the hyperbola quintissence algorithm.
-  BitBoard pc     = OneHot[sq];
-  BitBoard masked = blockers & mask;
-  return ((masked - 2 * pc) ^ reversed(reversed(masked) - 2 * OneHot[63 - sq])) & mask;
+  // 512 byte table instead of the hyperbola trick, which can't reverse a rank cheaply.
+  static constexpr std::array<std::array<uint8_t, 8>, 64> sFirstRankAttacks =
+    firstRankAttacks();
+  int rankShift = sq & 56;
+  return BitBoard(sFirstRankAttacks[(blockers >> (rankShift + 1)) & 63][sq & 7])
+         << rankShift;
 }
 
-BitBoard bishopMoves(int sq, BitBoard blockers)
+static BitBoard portableBishopMoves(int sq, BitBoard blockers)
 {
   return sliderMoves(sq, blockers, Diagonal[sq]) |
          sliderMoves(sq, blockers, AntiDiagonal[sq]);
 }
 
+static BitBoard portableRookMoves(int sq, BitBoard blockers)
+{
+  return sliderMoves(sq, blockers, File[sq]) | rankMoves(sq, blockers);
+}
+
+#endif  // POTATO_MAGIC_SLIDERS
+
+#if defined(POTATO_PEXT_SLIDERS) && defined(__x86_64__)
+
+/* PEXT indexed attack tables. These share the masks and offsets with the magic tables,
+ * but the attacks are stored in the order of the extracted bits, so the table is filled
+ * at startup, and only on CPUs that support BMI2. The same binary falls back to the
+ * portable lookups on older CPUs.
+ */
+static std::array<BitBoard, SliderAttacks.size()> sPextAttacks;
+
+__attribute__((target("bmi2"))) static BitBoard pextBishopMoves(int sq, BitBoard blockers)
+{
+  return sPextAttacks[BishopOffsets[sq] + _pext_u64(blockers, BishopMasks[sq])];
+}
+
+__attribute__((target("bmi2"))) static BitBoard pextRookMoves(int sq, BitBoard blockers)
+{
+  return sPextAttacks[RookOffsets[sq] + _pext_u64(blockers, RookMasks[sq])];
+}
+
+__attribute__((target("bmi2"))) static void fillPextAttacks(
+  const std::array<BitBoard, 64>& masks,
+  const std::array<uint32_t, 64>& offsets,
+  BitBoard (*attacks)(int, BitBoard))
+{
+  for (int sq = 0; sq < 64; ++sq) {
+    BitBoard mask = masks[sq];
+    BitBoard sub  = 0;
+    do {  // Carry-Rippler over all subsets of the mask.
+      sPextAttacks[offsets[sq] + _pext_u64(sub, mask)] = attacks(sq, sub);
+      sub                                              = (sub - mask) & mask;
+    } while (sub);
+  }
+}
+
+static bool initPextAttacks()
+{
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("bmi2")) {
+    return false;
+  }
+  fillPextAttacks(BishopMasks, BishopOffsets, portableBishopMoves);
+  fillPextAttacks(RookMasks, RookOffsets, portableRookMoves);
+  return true;
+}
+
+// Checked once at startup. Until then, the portable lookups are used.
+static const bool sUsePext = initPextAttacks();
+
+BitBoard bishopMoves(int sq, BitBoard blockers)
+{
+  return sUsePext ? pextBishopMoves(sq, blockers) : portableBishopMoves(sq, blockers);
+}
+
+BitBoard rookMoves(int sq, BitBoard blockers)
+{
+  return sUsePext ? pextRookMoves(sq, blockers) : portableRookMoves(sq, blockers);
+}
+
+#else
+
+BitBoard bishopMoves(int sq, BitBoard blockers)
+{
+  return portableBishopMoves(sq, blockers);
+}
+
 BitBoard rookMoves(int sq, BitBoard blockers)
 {
-  return sliderMoves(sq, blockers, File[sq]) | sliderMoves(sq, blockers, Rank[sq]);
+  return portableRookMoves(sq, blockers);
 }
 
+#endif  // POTATO_PEXT_SLIDERS
+
 BitBoard queenMoves(int sq, BitBoard blockers)
 {
   return bishopMoves(sq, blockers) | rookMoves(sq, blockers);
@@ -353,6 +537,111 @@ constexpr BitBoard shift(BitBoard b)
   }
 }
 
+/**
+ * @brief Kogge-Stone occluded fill in one direction, followed by a single step in that
+ * direction, to get the squares attacked by all the sliders at once.
+ */
+template<Direction Dir>
+BitBoard occludedFillAttacks(BitBoard gen, BitBoard empty)
+{
+  // Squares that can be stepped into in this direction without wrapping around the board.
+  static constexpr BitBoard Wrap = shift<Dir>(~BitBoard(0));
+  static constexpr int      Step = Dir > 0 ? int(Dir) : -int(Dir);
+  auto raw = [](BitBoard b, int n) { return Dir > 0 ? b << n : b >> n; };
+  BitBoard pro = empty & Wrap;
+  gen |= pro & raw(gen, Step);
+  pro &= raw(pro, Step);
+  gen |= pro & raw(gen, 2 * Step);
+  pro &= raw(pro, 2 * Step);
+  gen |= pro & raw(gen, 4 * Step);
+  return shift<Dir>(gen);
+}
+
+static BitBoard scalarSliderAttackFill(BitBoard diagonal,
+                                       BitBoard orthogonal,
+                                       BitBoard empty)
+{
+  return occludedFillAttacks<N>(orthogonal, empty) |
+         occludedFillAttacks<S>(orthogonal, empty) |
+         occludedFillAttacks<E>(orthogonal, empty) |
+         occludedFillAttacks<W>(orthogonal, empty) |
+         occludedFillAttacks<NE>(diagonal, empty) |
+         occludedFillAttacks<NW>(diagonal, empty) |
+         occludedFillAttacks<SE>(diagonal, empty) |
+         occludedFillAttacks<SW>(diagonal, empty);
+}
+
+#if defined(POTATO_AVX2) && defined(__x86_64__)
+
+/* All eight directions in two vectors. The lanes of the first vector are shifted left
+ * (W, NE, N, NW) and the lanes of the second vector are shifted right (E, SW, S, SE), by
+ * 1, 7, 8 and 9 respectively.
+ */
+__attribute__((target("avx2"))) static BitBoard avx2SliderAttackFill(BitBoard diagonal,
+                                                                     BitBoard orthogonal,
+                                                                     BitBoard empty)
+{
+  const __m256i s1    = _mm256_setr_epi64x(1, 7, 8, 9);
+  const __m256i s2    = _mm256_add_epi64(s1, s1);
+  const __m256i s4    = _mm256_add_epi64(s2, s2);
+  const __m256i lwrap = _mm256_setr_epi64x(NotAFile, NotHFile, -1, NotAFile);
+  const __m256i rwrap = _mm256_setr_epi64x(NotHFile, NotAFile, -1, NotHFile);
+  const __m256i sq    = _mm256_set1_epi64x(int64_t(empty));
+  __m256i       lgen  = _mm256_setr_epi64x(orthogonal, diagonal, orthogonal, diagonal);
+  __m256i       rgen  = lgen;
+  __m256i       lpro  = _mm256_and_si256(sq, lwrap);
+  __m256i       rpro  = _mm256_and_si256(sq, rwrap);
+  lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s1)));
+  rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s1)));
+  lpro = _mm256_and_si256(lpro, _mm256_sllv_epi64(lpro, s1));
+  rpro = _mm256_and_si256(rpro, _mm256_srlv_epi64(rpro, s1));
+  lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s2)));
+  rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s2)));
+  lpro = _mm256_and_si256(lpro, _mm256_sllv_epi64(lpro, s2));
+  rpro = _mm256_and_si256(rpro, _mm256_srlv_epi64(rpro, s2));
+  lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s4)));
+  rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s4)));
+  __m256i attacks =
+    _mm256_or_si256(_mm256_and_si256(_mm256_sllv_epi64(lgen, s1), lwrap),
+                    _mm256_and_si256(_mm256_srlv_epi64(rgen, s1), rwrap));
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(attacks),
+                              _mm256_extracti128_si256(attacks, 1));
+  return BitBoard(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+
+static bool hasAvx2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+static const bool sUseAvx2 = hasAvx2();
+
+BitBoard sliderAttackFill(BitBoard diagonal, BitBoard orthogonal, BitBoard empty)
+{
+  return sUseAvx2 ? avx2SliderAttackFill(diagonal, orthogonal, empty)
+                  : scalarSliderAttackFill(diagonal, orthogonal, empty);
+}
+
+#else
+
+BitBoard sliderAttackFill(BitBoard diagonal, BitBoard orthogonal, BitBoard empty)
+{
+  return scalarSliderAttackFill(diagonal, orthogonal, empty);
+}
+
+#endif  // POTATO_AVX2
+
+BitBoard pawnAttacks(Color c, BitBoard pawns)
+{
+  if (c == WHT) {
+    return shift<RelativeDir<NE, WHT>>(pawns) | shift<RelativeDir<NW, WHT>>(pawns);
+  }
+  else {
+    return shift<RelativeDir<NE, BLK>>(pawns) | shift<RelativeDir<NW, BLK>>(pawns);
+  }
+}
+
 template<Color Player>
 BitBoard pawnCapturesFromPos(int pos)
 {
@@ -364,9 +653,9 @@ BitBoard pawnCapturesFromPos(int pos)
   }
 }
 
-template<Color Player, Direction Dir>
+template<Color Player, Direction Dir, typename Moves>
 void generatePawnCaptures(const Position& p,
-                          MoveList&       moves,
+                          Moves&          moves,
                           BitBoard        pinned,
                           BitBoard        enemy,
                           BitBoard        mask,
@@ -380,10 +669,7 @@ void generatePawnCaptures(const Position& p,
   if (mask) {
     pmoves &= mask;
   }
-  while (pmoves) {
-    int pos = pop(pmoves);
-    moves.append(CAPTURE | OTHER, pos - RelativeDir<Dir, Player>, pos);
-  }
+  moves.addPawnMoves(OTHER, RelativeDir<Dir, Player>, pmoves);
   // pinned.
   pmoves = shift<RelativeDir<Dir, Player>>(pcs & pinned) & enemy;
   if (mask) {
@@ -393,14 +679,14 @@ void generatePawnCaptures(const Position& p,
     int pto   = pop(pmoves);
     int pfrom = pto - RelativeDir<Dir, Player>;
     if (LineMask[pfrom][kingPos] & OneHot[pto]) {
-      moves.append(CAPTURE | OTHER, pfrom, pto);
+      moves.append(OTHER, pfrom, pto);
     }
   }
 }
 
-template<Color Player, Direction Dir>
+template<Color Player, Direction Dir, typename Moves>
 void generatePawnCapturePromotions(const Position& p,
-                                   MoveList&       moves,
+                                   Moves&          moves,
                                    BitBoard        pinned,
                                    BitBoard        enemy,
                                    BitBoard        mask,
@@ -418,19 +704,12 @@ void generatePawnCapturePromotions(const Position& p,
   if (mask) {
     pmoves &= mask;
   }
-  while (pmoves) {
-    int to   = pop(pmoves);
-    int from = to - RelativeDir<Dir, Player>;
-    moves.append(CAPTURE | PRC_HRS, from, to);
-    moves.append(CAPTURE | PRC_BSH, from, to);
-    moves.append(CAPTURE | PRC_ROK, from, to);
-    moves.append(CAPTURE | PRC_QEN, from, to);
-  }
+  moves.addPromotions(PRC_HRS, RelativeDir<Dir, Player>, pmoves);
 }
 
-template<Color Player, Direction Dir>
+template<Color Player, Direction Dir, typename Moves>
 void generateEnpassant(const Position& p,
-                       MoveList&       moves,
+                       Moves&          moves,
                        BitBoard        pinned,
                        int             kingPos,
                        BitBoard        all)
@@ -468,9 +747,9 @@ void generateEnpassant(const Position& p,
   }
 }
 
-template<Color Player, int Steps>
+template<Color Player, int Steps, typename Moves>
 void generatePawnPushMoves(const Position& p,
-                           MoveList&       moves,
+                           Moves&          moves,
                            BitBoard        pinned,
                            BitBoard        empty,
                            BitBoard        mask,
@@ -503,20 +782,12 @@ void generatePawnPushMoves(const Position& p,
   if (mask) {
     pmoves &= mask;
   }
-  while (pmoves) {
-    int pos = pop(pmoves);
-    if constexpr (Steps == 1) {
-      moves.append(PUSH, pos - Steps * Up, pos);
-    }
-    else {
-      moves.append(DBL_PUSH, pos - Steps * Up, pos);
-    }
-  }
+  moves.addPawnMoves(Steps == 1 ? PUSH : DBL_PUSH, Steps * Up, pmoves);
 }
 
-template<Color Player>
+template<Color Player, typename Moves>
 void generatePawnPromotionMoves(const Position& p,
-                                MoveList&       moves,
+                                Moves&          moves,
                                 BitBoard        pinned,
                                 BitBoard        empty,
                                 BitBoard        mask)
@@ -529,48 +800,38 @@ void generatePawnPromotionMoves(const Position& p,
   if (mask) {
     pmoves &= mask;
   }
-  while (pmoves) {
-    int to   = pop(pmoves);
-    int from = to - Up;
-    moves.append(PRM_HRS, from, to);
-    moves.append(PRM_BSH, from, to);
-    moves.append(PRM_ROK, from, to);
-    moves.append(PRM_QEN, from, to);
-  }
+  moves.addPromotions(PRM_HRS, Up, pmoves);
 }
 
-template<Color Player>
+template<Color Player, typename Moves>
 void generateDiagSlides(const Position& p,
-                        MoveList&       moves,
+                        Moves&          moves,
                         BitBoard        pinned,
                         BitBoard        all,
-                        BitBoard        notself,
+                        BitBoard        targets,
                         BitBoard        mask,
                         int             kingPos)
 {
   auto sliders = getBoard<Player, BSH, QEN>(p);
   while (sliders) {
     int  pos    = pop(sliders);
-    auto pmoves = bishopMoves(pos, all) & notself;
+    auto pmoves = bishopMoves(pos, all) & targets;
     if (mask) {
       pmoves &= mask;
     }
     if (OneHot[pos] & pinned) {
       pmoves &= LineMask[kingPos][pos];
     }
-    while (pmoves) {
-      int dst = pop(pmoves);
-      moves.append(OTHER, pos, dst, p.piece(dst));
-    }
+    moves.addMoves(OTHER, pos, pmoves);
   }
 }
 
-template<Color Player, PieceType PType>
+template<Color Player, PieceType PType, typename Moves>
 void generateOrthoSlidesHelper(const Position& p,
-                               MoveList&       moves,
+                               Moves&          moves,
                                BitBoard        pinned,
                                BitBoard        all,
-                               BitBoard        notself,
+                               BitBoard        targets,
                                BitBoard        mask,
                                int             kingPos,
                                MoveType        mtype)
@@ -578,48 +839,320 @@ void generateOrthoSlidesHelper(const Position& p,
   auto sliders = getBoard<Player, PType>(p);
   while (sliders) {
     int  pos    = pop(sliders);
-    auto pmoves = rookMoves(pos, all) & notself;
+    auto pmoves = rookMoves(pos, all) & targets;
     if (mask) {
       pmoves &= mask;
     }
     if (OneHot[pos] & pinned) {
       pmoves &= LineMask[kingPos][pos];
     }
-    while (pmoves) {
-      int dst = pop(pmoves);
-      moves.append(mtype, pos, dst, p.piece(dst));
-    }
+    moves.addMoves(mtype, pos, pmoves);
   }
 }
 
-template<Color Player>
+template<Color Player, typename Moves>
 void generateOrthoSlides(const Position& p,
-                         MoveList&       moves,
+                         Moves&          moves,
                          BitBoard        pinned,
                          BitBoard        all,
-                         BitBoard        notself,
+                         BitBoard        targets,
                          BitBoard        mask,
                          int             kingPos)
 {
   generateOrthoSlidesHelper<Player, ROK>(
-    p, moves, pinned, all, notself, mask, kingPos, MV_ROK);
+    p, moves, pinned, all, targets, mask, kingPos, MV_ROK);
   generateOrthoSlidesHelper<Player, QEN>(
-    p, moves, pinned, all, notself, mask, kingPos, OTHER);
+    p, moves, pinned, all, targets, mask, kingPos, OTHER);
+}
+
+template<Color Player>
+CheckInfo checkInfo(const Position& p)
+{
+  static constexpr Color Enemy   = Player == BLK ? WHT : BLK;
+  BitBoard               self    = getAllBoards<Player>(p);
+  BitBoard               all     = p.occupied();
+  int                    kingPos = lsb(getBoard<Enemy, KNG>(p));
+  BitBoard               diags   = bishopMoves(kingPos, all);
+  BitBoard               orthos  = rookMoves(kingPos, all);
+  CheckInfo              ci;
+  ci.mKingPos      = kingPos;
+  ci.mSquares[PWN] = pawnCapturesFromPos<Enemy>(kingPos);
+  ci.mSquares[HRS] = KnightMoves[kingPos];
+  ci.mSquares[BSH] = diags;
+  ci.mSquares[ROK] = orthos;
+  ci.mSquares[QEN] = diags | orthos;
+  // Sliders that would see the king if it weren't for the blockers.
+  BitBoard snipers = (bishopMoves(kingPos, 0) & getBoard<Player, BSH, QEN>(p)) |
+                     (rookMoves(kingPos, 0) & getBoard<Player, ROK, QEN>(p));
+  while (snipers) {
+    BitBoard blockers = Between[kingPos][pop(snipers)] & all;
+    if (std::popcount(blockers) == 1) {
+      ci.mDiscoverers |= blockers & self;
+    }
+  }
+  return ci;
+}
+
+CheckInfo CheckInfo::fromPosition(const Position& p)
+{
+  return p.turn() == WHT ? checkInfo<WHT>(p) : checkInfo<BLK>(p);
+}
+
+/**
+ * @brief Check if the player's piece on the given square gives a discovered check by
+ * moving to the given square.
+ */
+inline bool discovers(const CheckInfo& ci, int from, int to)
+{
+  return (ci.mDiscoverers & OneHot[from]) && !(LineMask[ci.mKingPos][from] & OneHot[to]);
+}
+
+/**
+ * @brief Check if a promoted piece on the given square attacks the enemy king.
+ */
+template<PieceType Promoted>
+bool promotionChecks(const CheckInfo& ci, int to, BitBoard occupied)
+{
+  BitBoard king = OneHot[ci.mKingPos];
+  if constexpr (Promoted == HRS) {
+    return KnightMoves[to] & king;
+  }
+  else if constexpr (Promoted == BSH) {
+    return bishopMoves(to, occupied) & king;
+  }
+  else if constexpr (Promoted == ROK) {
+    return rookMoves(to, occupied) & king;
+  }
+  else {
+    return queenMoves(to, occupied) & king;
+  }
+}
+
+/**
+ * @brief Check if castling gives check, i.e. if the rook lands on a checking square.
+ */
+template<Color Player, MoveType Castling>
+bool castlingChecks(const CheckInfo& ci, BitBoard all)
+{
+  static constexpr bool Short    = Castling == CASTLE_SHORT;
+  static constexpr int  HomeRank = RelativeRank<Player, 0>;
+  static constexpr int  KingFrom = HomeRank * 8 + 4;
+  static constexpr int  KingTo   = HomeRank * 8 + (Short ? 6 : 2);
+  static constexpr int  RookFrom = HomeRank * 8 + (Short ? 7 : 0);
+  static constexpr int  RookTo   = HomeRank * 8 + (Short ? 5 : 3);
+  BitBoard occupied = (all & ~(OneHot[KingFrom] | OneHot[RookFrom])) | OneHot[KingTo] |
+                      OneHot[RookTo];
+  return rookMoves(RookTo, occupied) & OneHot[ci.mKingPos];
+}
+
+template<Color Player>
+bool givesCheck(const Position& p, Move m, const CheckInfo& ci)
+{
+  int      from     = m.from();
+  int      to       = m.to();
+  BitBoard all      = p.occupied();
+  MoveType mtype    = m.type();
+  BitBoard occupied = (all ^ OneHot[from]) | OneHot[to];
+  switch (mtype) {
+  case CASTLE_SHORT:
+    return castlingChecks<Player, CASTLE_SHORT>(ci, all);
+  case CASTLE_LONG:
+    return castlingChecks<Player, CASTLE_LONG>(ci, all);
+  default:
+    break;
+  }
+  if (discovers(ci, from, to)) {
+    return true;
+  }
+  switch (mtype) {
+  case PRM_HRS:
+  case PRC_HRS:
+    return promotionChecks<HRS>(ci, to, occupied);
+  case PRM_BSH:
+  case PRC_BSH:
+    return promotionChecks<BSH>(ci, to, occupied);
+  case PRM_ROK:
+  case PRC_ROK:
+    return promotionChecks<ROK>(ci, to, occupied);
+  case PRM_QEN:
+  case PRC_QEN:
+    return promotionChecks<QEN>(ci, to, occupied);
+  case ENPASSANT: {
+    if (ci.mSquares[PWN] & OneHot[to]) {
+      return true;
+    }
+    // The captured pawn can also be the only blocker of a slider.
+    occupied ^= OneHot[(from / 8) * 8 + to % 8];
+    return (bishopMoves(ci.mKingPos, occupied) & getBoard<Player, BSH, QEN>(p)) |
+           (rookMoves(ci.mKingPos, occupied) & getBoard<Player, ROK, QEN>(p));
+  }
+  default:
+    return ci.mSquares[type(p.piece(from))] & OneHot[to];
+  }
+}
+
+bool givesCheck(const Position& p, Move m, const CheckInfo& ci)
+{
+  return p.turn() == WHT ? givesCheck<WHT>(p, m, ci) : givesCheck<BLK>(p, m, ci);
+}
+
+bool givesCheck(const Position& p, Move m)
+{
+  return givesCheck(p, m, CheckInfo::fromPosition(p));
+}
+
+/**
+ * @brief Generate the quiet moves that give check, when the player is not in check. The
+ * target bitboards of every piece are masked with the squares that check the enemy king,
+ * unless the piece is a discoverer.
+ */
+template<Color Player>
+void generateQuietChecks(const Position& p,
+                         MoveList&       moves,
+                         BitBoard        pinned,
+                         BitBoard        all,
+                         BitBoard        unsafe,
+                         int             kingPos)
+{
+  static constexpr Direction Up           = RelativeDir<N, Player>;
+  static constexpr BitBoard  Rank3        = Rank[RelativeRank<Player, 2> * 8];
+  static constexpr BitBoard  Rank7        = Rank[RelativeRank<Player, 6> * 8];
+  BitBoard                   empty        = ~all;
+  CheckInfo                  ci           = checkInfo<Player>(p);
+  auto                       checkTargets = [&](int pos, PieceType type) {
+    BitBoard out = ci.mSquares[type];
+    if (ci.mDiscoverers & OneHot[pos]) {
+      out |= ~LineMask[ci.mKingPos][pos];
+    }
+    if (pinned & OneHot[pos]) {
+      out &= LineMask[kingPos][pos];
+    }
+    return out & empty;
+  };
+  {  // Pawn pushes. Pawns that are pinned or discoverers are handled one at a time.
+    BitBoard pawns   = getBoard<Player, PWN>(p) & ~Rank7;
+    BitBoard special = pawns & (pinned | ci.mDiscoverers);
+    pawns &= ~special;
+    BitBoard single = shift<Up>(pawns) & empty;
+    BitBoard dbl    = shift<Up>(single & Rank3) & empty & ci.mSquares[PWN];
+    single &= ci.mSquares[PWN];
+    while (single) {
+      int to = pop(single);
+      moves.append(PUSH, to - Up, to);
+    }
+    while (dbl) {
+      int to = pop(dbl);
+      moves.append(DBL_PUSH, to - 2 * Up, to);
+    }
+    while (special) {
+      int      from    = pop(special);
+      BitBoard targets = checkTargets(from, PWN);
+      BitBoard one     = shift<Up>(OneHot[from]) & empty;
+      BitBoard two     = shift<Up>(one & Rank3) & empty;
+      if (one & targets) {
+        moves.append(PUSH, from, from + Up);
+      }
+      if (two & targets) {
+        moves.append(DBL_PUSH, from, from + 2 * Up);
+      }
+    }
+  }
+  {  // Promotions. Pinned pawns cannot promote.
+    BitBoard pmoves = shift<Up>(getBoard<Player, PWN>(p) & Rank7 & ~pinned) & empty;
+    while (pmoves) {
+      int      to       = pop(pmoves);
+      int      from     = to - Up;
+      BitBoard occupied = all & ~OneHot[from];
+      bool     disc     = discovers(ci, from, to);
+      if (disc || promotionChecks<HRS>(ci, to, occupied)) {
+        moves.append(PRM_HRS, from, to);
+      }
+      if (disc || promotionChecks<BSH>(ci, to, occupied)) {
+        moves.append(PRM_BSH, from, to);
+      }
+      if (disc || promotionChecks<ROK>(ci, to, occupied)) {
+        moves.append(PRM_ROK, from, to);
+      }
+      if (disc || promotionChecks<QEN>(ci, to, occupied)) {
+        moves.append(PRM_QEN, from, to);
+      }
+    }
+  }
+  // Pinned knights cannot move.
+  for (BitBoard pcs = getBoard<Player, HRS>(p) & ~pinned; pcs;) {
+    int pos = pop(pcs);
+    for (BitBoard pmoves = KnightMoves[pos] & checkTargets(pos, HRS); pmoves;) {
+      moves.append(OTHER, pos, pop(pmoves));
+    }
+  }
+  for (BitBoard pcs = getBoard<Player, BSH>(p); pcs;) {
+    int pos = pop(pcs);
+    for (BitBoard pmoves = bishopMoves(pos, all) & checkTargets(pos, BSH); pmoves;) {
+      moves.append(OTHER, pos, pop(pmoves));
+    }
+  }
+  for (BitBoard pcs = getBoard<Player, ROK>(p); pcs;) {
+    int pos = pop(pcs);
+    for (BitBoard pmoves = rookMoves(pos, all) & checkTargets(pos, ROK); pmoves;) {
+      moves.append(MV_ROK, pos, pop(pmoves));
+    }
+  }
+  for (BitBoard pcs = getBoard<Player, QEN>(p); pcs;) {
+    int pos = pop(pcs);
+    for (BitBoard pmoves = queenMoves(pos, all) & checkTargets(pos, QEN); pmoves;) {
+      moves.append(OTHER, pos, pop(pmoves));
+    }
+  }
+  // The king can only give a discovered check.
+  if (ci.mDiscoverers & OneHot[kingPos]) {
+    BitBoard kmoves =
+      KingMoves[kingPos] & ~unsafe & empty & ~LineMask[ci.mKingPos][kingPos];
+    while (kmoves) {
+      moves.append(MV_KNG, kingPos, pop(kmoves));
+    }
+  }
+  {  // Castling, if the rook lands on a checking square.
+    static constexpr Castle CastleLong  = Player == WHT ? W_LONG : B_LONG;
+    static constexpr Castle CastleShort = Player == WHT ? W_SHORT : B_SHORT;
+    static constexpr int    HomeRank    = RelativeRank<Player, 0>;
+    static constexpr BitBoard LongSafe =
+      CastleSafeMask[std::countr_zero(uint8_t(CastleLong))];
+    static constexpr BitBoard LongEmpty =
+      CastleEmptyMask[std::countr_zero(uint8_t(CastleLong))];
+    static constexpr BitBoard ShortSafe =
+      CastleSafeMask[std::countr_zero(uint8_t(CastleShort))];
+    static constexpr BitBoard ShortEmpty =
+      CastleEmptyMask[std::countr_zero(uint8_t(CastleShort))];
+    Castle rights = p.castlingRights();
+    if ((rights & CastleLong) && !(LongEmpty & all) && !(LongSafe & unsafe) &&
+        castlingChecks<Player, CASTLE_LONG>(ci, all)) {
+      moves.append(CASTLE_LONG, HomeRank * 8 + 4, HomeRank * 8 + 2);
+    }
+    if ((rights & CastleShort) && !(ShortEmpty & all) && !(ShortSafe & unsafe) &&
+        castlingChecks<Player, CASTLE_SHORT>(ci, all)) {
+      moves.append(CASTLE_SHORT, HomeRank * 8 + 4, HomeRank * 8 + 6);
+    }
+  }
 }
 
 /**
  * @brief Generate legal moves for a position.
  *
  * @tparam Player The color to move.
+ * @tparam Type The kind of moves to generate. Moves of other kinds are masked out of the
+ * target bitboards, so they are never created.
  * @param p The position.
  * @param moves Legal moves will be written to this list. Previous contents will be
  * erased.
+ * @param info If not null, the attack maps, pins and checkers are written here.
  * @return bool Flag indicating if the player's king is in check. This may be used to
  * identify checkmate / stalemate.
  */
-template<Color Player>
-[[nodiscard]] bool generateMoves(const Position& p, MoveList& moves)
+template<Color Player, GenType Type, typename Moves>
+[[nodiscard]] bool generateMoves(const Position& p, Moves& moves, MoveGenInfo* info)
 {
+  static constexpr bool      Captures = Type == GenType::ALL || Type == GenType::CAPTURES;
+  static constexpr bool      Quiets   = Type == GenType::ALL || Type == GenType::QUIETS;
   static constexpr Direction Up           = RelativeDir<N, Player>;
   static constexpr BitBoard  HomePawnRank = Rank[RelativeRank<Player, 1> * 8];
   static constexpr Color     Enemy        = Player == BLK ? WHT : BLK;
@@ -634,28 +1167,38 @@ template<Color Player>
   int                        kingPos      = lsb(ourKing);
   int                        otherKingPos = lsb(otherKing);
   BitBoard                   unsafe       = 0;
+  // Squares the pieces are allowed to move to.
+  BitBoard targets = Type == GenType::CAPTURES ? enemy
+                     : Type == GenType::QUIETS ? empty
+                                               : notself;
   moves.clear();
   {  // Find all unsafe squares.
     BitBoard pcs = getBoard<Enemy, PWN>(p);
-    unsafe = shift<RelativeDir<NE, Enemy>>(pcs) | shift<RelativeDir<NW, Enemy>>(pcs) |
-             (KingMoves[otherKingPos] & notself);
-    auto attackers = getBoard<Enemy, BSH, QEN>(p);
-    auto allNoKing = all & (~ourKing);
-    while (attackers) {
-      unsafe |= bishopMoves(pop(attackers), allNoKing);
+    BitBoard byPawns =
+      shift<RelativeDir<NE, Enemy>>(pcs) | shift<RelativeDir<NW, Enemy>>(pcs);
+    BitBoard byKnights = 0;
+    for (BitBoard attackers = getBoard<Enemy, HRS>(p); attackers;) {
+      byKnights |= KnightMoves[pop(attackers)];
     }
-    attackers = getBoard<Enemy, ROK, QEN>(p);
-    while (attackers) {
-      unsafe |= rookMoves(pop(attackers), allNoKing);
+    unsafe = byPawns | byKnights | KingMoves[otherKingPos];
+    // The king is removed from the blockers, so it can't step back along a checking line.
+    if (info) {
+      // Separate fills, to report the diagonal and orthogonal attacks.
+      info->mPawnAttacks   = byPawns;
+      info->mKnightAttacks = byKnights;
+      info->mKingAttacks   = KingMoves[otherKingPos];
+      info->mDiagonalAttacks =
+        sliderAttackFill(getBoard<Enemy, BSH, QEN>(p), 0, empty | ourKing);
+      info->mOrthogonalAttacks =
+        sliderAttackFill(0, getBoard<Enemy, ROK, QEN>(p), empty | ourKing);
+      unsafe |= info->mDiagonalAttacks | info->mOrthogonalAttacks;
     }
-    attackers = getBoard<Enemy, HRS>(p);
-    while (attackers) {
-      unsafe |= KnightMoves[pop(attackers)];
+    else {
+      unsafe |= sliderAttackFill(
+        getBoard<Enemy, BSH, QEN>(p), getBoard<Enemy, ROK, QEN>(p), empty | ourKing);
     }
-    auto kmoves = KingMoves[kingPos] & (~(unsafe | self));
-    while (kmoves) {
-      int dst = pop(kmoves);
-      moves.append(MV_KNG, kingPos, dst, p.piece(dst));
+    if constexpr (Type != GenType::QUIET_CHECKS) {
+      moves.addMoves(MV_KNG, kingPos, KingMoves[kingPos] & ~unsafe & targets);
     }
   }
   BitBoard pinned   = 0;
@@ -681,14 +1224,27 @@ template<Color Player>
       case 2:  // Not in check, not pinned.
         break;
       }
-      if (OneHot[spos] & diags) {  // This is a diagonal slider.
-        unsafe |= bishopMoves(spos, all);
-      }
-      else if (OneHot[spos] & orthos) {
-        unsafe |= rookMoves(spos, all);
-      }
     }
   }
+  if (info) {
+    info->mUnsafe   = unsafe;
+    info->mPinned   = pinned;
+    info->mCheckers = checkers;
+  }
+  if constexpr (Type == GenType::QUIET_CHECKS) {
+    if (checkers) {
+      // Rare, so generate the quiet evasions and keep the ones that give check.
+      bool inCheck = generateMoves<Player, GenType::QUIETS>(p, moves, nullptr);
+      CheckInfo    ci      = checkInfo<Player>(p);
+      moves.resize(size_t(std::distance(
+        moves.begin(), std::remove_if(moves.begin(), moves.end(), [&](Move m) {
+          return !givesCheck<Player>(p, m, ci);
+        }))));
+      return inCheck;
+    }
+    generateQuietChecks<Player>(p, moves, pinned, all, unsafe, kingPos);
+    return false;
+  }
   switch (std::popcount(checkers)) {
   case 0:  // Do nothing.
     break;
@@ -699,13 +1255,17 @@ template<Color Player>
     bool isSlider = checkers & getBoard<Enemy, BSH, ROK, QEN>(p);
     auto line     = isSlider ? Between[cpos][kingPos] : 0;
     line |= checkers;
-    // Pawn captures
-    generatePawnCaptures<Player, NW>(p, moves, pinned, enemy, checkers, kingPos);
-    generatePawnCaptures<Player, NE>(p, moves, pinned, enemy, checkers, kingPos);
-    generatePawnCapturePromotions<Player, NW>(p, moves, pinned, enemy, checkers, kingPos);
-    generatePawnCapturePromotions<Player, NE>(p, moves, pinned, enemy, checkers, kingPos);
+    if constexpr (Captures) {
+      // Pawn captures
+      generatePawnCaptures<Player, NW>(p, moves, pinned, enemy, checkers, kingPos);
+      generatePawnCaptures<Player, NE>(p, moves, pinned, enemy, checkers, kingPos);
+      generatePawnCapturePromotions<Player, NW>(
+        p, moves, pinned, enemy, checkers, kingPos);
+      generatePawnCapturePromotions<Player, NE>(
+        p, moves, pinned, enemy, checkers, kingPos);
+    }
     // Enpassant captures.
-    if (p.enpassantSq() == cpos + RelativeDir<N, Player> &&
+    if (Captures && p.enpassantSq() == cpos + RelativeDir<N, Player> &&
         p.piece(cpos) == (Enemy | PWN)) {
       auto attackers = shift<RelativeDir<E, Player>>(checkers) & getBoard<Player, PWN>(p);
       if (attackers & pinned) {
@@ -722,23 +1282,21 @@ template<Color Player>
         moves.append(ENPASSANT, pop(attackers), p.enpassantSq());
       }
     }
-    // Block with a pawn push
-    generatePawnPushMoves<Player, 1>(p, moves, pinned, empty, line, kingPos);  // single
-    generatePawnPushMoves<Player, 2>(p, moves, pinned, empty, line, kingPos);  // double
-    // Block with a promotion
-    generatePawnPromotionMoves<Player>(p, moves, pinned, empty, line);
+    if constexpr (Quiets) {
+      // Block with a pawn push
+      generatePawnPushMoves<Player, 1>(p, moves, pinned, empty, line, kingPos);  // single
+      generatePawnPushMoves<Player, 2>(p, moves, pinned, empty, line, kingPos);  // double
+      // Block with a promotion
+      generatePawnPromotionMoves<Player>(p, moves, pinned, empty, line);
+    }
     // Knight captures and blocks.
     auto attackers = getBoard<Player, HRS>(p) & ~pinned;
     while (attackers) {
-      int  hpos   = pop(attackers);
-      auto hmoves = KnightMoves[hpos] & (checkers | line) & notself;
-      while (hmoves) {
-        int dst = pop(hmoves);
-        moves.append(OTHER, hpos, dst, p.piece(dst));
-      }
+      int hpos = pop(attackers);
+      moves.addMoves(OTHER, hpos, KnightMoves[hpos] & line & targets);
     }
-    generateDiagSlides<Player>(p, moves, pinned, all, notself, line, kingPos);
-    generateOrthoSlides<Player>(p, moves, pinned, all, notself, line, kingPos);
+    generateDiagSlides<Player>(p, moves, pinned, all, targets, line, kingPos);
+    generateOrthoSlides<Player>(p, moves, pinned, all, targets, line, kingPos);
     // Generated all the moves to get out of check.
     // No more legal moves.
     return true;
@@ -749,100 +1307,551 @@ template<Color Player>
     return true;
   }
   {
-    generatePawnPushMoves<Player, 1>(p, moves, pinned, empty, 0, kingPos);  // Single push
-    generatePawnPushMoves<Player, 2>(p, moves, pinned, empty, 0, kingPos);  // Double push
-    // Pawn captures
-    generatePawnCaptures<Player, NE>(p, moves, pinned, enemy, 0, kingPos);
-    generatePawnCaptures<Player, NW>(p, moves, pinned, enemy, 0, kingPos);
-    // Pawn promotions.
-    generatePawnPromotionMoves<Player>(p, moves, pinned, empty, 0);
-    // Pawn capture promotions.
-    generatePawnCapturePromotions<Player, NE>(p, moves, pinned, enemy, 0, kingPos);
-    generatePawnCapturePromotions<Player, NW>(p, moves, pinned, enemy, 0, kingPos);
-    // Enpassant
-    generateEnpassant<Player, E>(p, moves, pinned, kingPos, all);
-    generateEnpassant<Player, W>(p, moves, pinned, kingPos, all);
+    if constexpr (Quiets) {
+      generatePawnPushMoves<Player, 1>(p, moves, pinned, empty, 0, kingPos);  // Single
+      generatePawnPushMoves<Player, 2>(p, moves, pinned, empty, 0, kingPos);  // Double
+      // Pawn promotions.
+      generatePawnPromotionMoves<Player>(p, moves, pinned, empty, 0);
+    }
+    if constexpr (Captures) {
+      // Pawn captures
+      generatePawnCaptures<Player, NE>(p, moves, pinned, enemy, 0, kingPos);
+      generatePawnCaptures<Player, NW>(p, moves, pinned, enemy, 0, kingPos);
+      // Pawn capture promotions.
+      generatePawnCapturePromotions<Player, NE>(p, moves, pinned, enemy, 0, kingPos);
+      generatePawnCapturePromotions<Player, NW>(p, moves, pinned, enemy, 0, kingPos);
+      // Enpassant
+      generateEnpassant<Player, E>(p, moves, pinned, kingPos, all);
+      generateEnpassant<Player, W>(p, moves, pinned, kingPos, all);
+    }
     // Pinned knights cannot be moved. Only try to move unpinned knights.
     auto pcs = getBoard<Player, HRS>(p) & ~pinned;
     while (pcs) {
-      int  pos    = pop(pcs);
-      auto pmoves = KnightMoves[pos] & notself;
-      while (pmoves) {
-        int dst = pop(pmoves);
-        moves.append(OTHER, pos, dst, p.piece(dst));
-      }
+      int pos = pop(pcs);
+      moves.addMoves(OTHER, pos, KnightMoves[pos] & targets);
     }
     // Sliders
-    generateDiagSlides<Player>(p, moves, pinned, all, notself, 0, kingPos);
-    generateOrthoSlides<Player>(p, moves, pinned, all, notself, 0, kingPos);
-    // Castling.
-    static constexpr Castle CastleLong = Player == WHT ? Castle::W_LONG : Castle::B_LONG;
-    static constexpr Castle CastleShort =
-      Player == WHT ? Castle::W_SHORT : Castle::B_SHORT;
-    static constexpr BitBoard CastleLongSafeMask =
-      CastleSafeMask[std::countr_zero(uint8_t(CastleLong))];
-    static constexpr BitBoard CastleLongEmptyMask =
+    generateDiagSlides<Player>(p, moves, pinned, all, targets, 0, kingPos);
+    generateOrthoSlides<Player>(p, moves, pinned, all, targets, 0, kingPos);
+    if constexpr (Quiets) {
+      // Castling.
+      static constexpr Castle CastleLong =
+        Player == WHT ? Castle::W_LONG : Castle::B_LONG;
+      static constexpr Castle CastleShort =
+        Player == WHT ? Castle::W_SHORT : Castle::B_SHORT;
+      static constexpr BitBoard CastleLongSafeMask =
+        CastleSafeMask[std::countr_zero(uint8_t(CastleLong))];
+      static constexpr BitBoard CastleLongEmptyMask =
+        CastleEmptyMask[std::countr_zero(uint8_t(CastleLong))];
+      static constexpr BitBoard CastleShortSafeMask =
+        CastleSafeMask[std::countr_zero(uint8_t(CastleShort))];
+      static constexpr BitBoard CastleShortEmptyMask =
+        CastleEmptyMask[std::countr_zero(uint8_t(CastleShort))];
+      Castle rights = p.castlingRights();
+      if ((rights & CastleLong) && !(CastleLongEmptyMask & all) &&
+          !(CastleLongSafeMask & unsafe)) {
+        moves.append(CASTLE_LONG,
+                     RelativeRank<Player, 0> * 8 + 4,
+                     RelativeRank<Player, 0> * 8 + 2);
+      }
+      if ((rights & CastleShort) && !(CastleShortEmptyMask & all) &&
+          !(CastleShortSafeMask & unsafe)) {
+        moves.append(CASTLE_SHORT,
+                     RelativeRank<Player, 0> * 8 + 4,
+                     RelativeRank<Player, 0> * 8 + 6);
+      }
+    }
+  }
+  return false;
+}
+
+template<GenType Type>
+bool generateMoves(const Position& p, MoveList& moves)
+{
+  if (p.turn() == WHT) {
+    return generateMoves<WHT, Type>(p, moves, nullptr);
+  }
+  else if (p.turn() == BLK) {
+    return generateMoves<BLK, Type>(p, moves, nullptr);
+  }
+  return false;
+}
+
+template<GenType Type>
+bool generateMoves(const Position& p, MoveList& moves, MoveGenInfo& info)
+{
+  if (p.turn() == WHT) {
+    return generateMoves<WHT, Type>(p, moves, &info);
+  }
+  else if (p.turn() == BLK) {
+    return generateMoves<BLK, Type>(p, moves, &info);
+  }
+  return false;
+}
+
+template<GenType Type>
+size_t countMoves(const Position& p)
+{
+  static_assert(Type != GenType::QUIET_CHECKS, "Quiet checks can't be counted");
+  MoveCounter counter;
+  if (p.turn() == WHT) {
+    (void)generateMoves<WHT, Type>(p, counter, nullptr);
+  }
+  else if (p.turn() == BLK) {
+    (void)generateMoves<BLK, Type>(p, counter, nullptr);
+  }
+  return counter.size();
+}
+
+template bool generateMoves<GenType::ALL>(const Position&, MoveList&);
+template bool generateMoves<GenType::CAPTURES>(const Position&, MoveList&);
+template bool generateMoves<GenType::QUIETS>(const Position&, MoveList&);
+template bool generateMoves<GenType::QUIET_CHECKS>(const Position&, MoveList&);
+template bool generateMoves<GenType::ALL>(const Position&, MoveList&, MoveGenInfo&);
+template bool generateMoves<GenType::CAPTURES>(const Position&, MoveList&, MoveGenInfo&);
+template bool generateMoves<GenType::QUIETS>(const Position&, MoveList&, MoveGenInfo&);
+template bool generateMoves<GenType::QUIET_CHECKS>(const Position&,
+                                                   MoveList&,
+                                                   MoveGenInfo&);
+template size_t countMoves<GenType::ALL>(const Position&);
+template size_t countMoves<GenType::CAPTURES>(const Position&);
+template size_t countMoves<GenType::QUIETS>(const Position&);
+
+bool generateMoves(const Position& p, MoveList& moves)
+{
+  return generateMoves<GenType::ALL>(p, moves);
+}
+
+bool generateMoves(const Position& p, MoveList& moves, MoveGenInfo& info)
+{
+  return generateMoves<GenType::ALL>(p, moves, info);
+}
+
+size_t countMoves(const Position& p)
+{
+  return countMoves<GenType::ALL>(p);
+}
+
+/**
+ * @brief Get the enemy pieces that attack a square.
+ *
+ * @param occupied Pieces that block the sliders.
+ */
+template<Color Enemy>
+BitBoard enemyAttackers(const Position& p, int sq, BitBoard occupied)
+{
+  static constexpr Color Player = Enemy == BLK ? WHT : BLK;
+  return (pawnCapturesFromPos<Player>(sq) & getBoard<Enemy, PWN>(p)) |
+         (KnightMoves[sq] & getBoard<Enemy, HRS>(p)) |
+         (KingMoves[sq] & getBoard<Enemy, KNG>(p)) |
+         (bishopMoves(sq, occupied) & getBoard<Enemy, BSH, QEN>(p)) |
+         (rookMoves(sq, occupied) & getBoard<Enemy, ROK, QEN>(p));
+}
+
+template<Color Player>
+bool isInCheck(const Position& p)
+{
+  static constexpr Color Enemy = Player == BLK ? WHT : BLK;
+  return enemyAttackers<Enemy>(p, lsb(getBoard<Player, KNG>(p)), p.occupied());
+}
+
+/**
+ * @brief Generate pseudo-legal moves, i.e. moves that follow the movement rules of the
+ * pieces, but may leave the player's king in check. No pins, checkers or unsafe squares
+ * are computed. Each move must be tested with isLegal before it is played.
+ */
+template<Color Player, GenType Type>
+[[nodiscard]] bool generatePseudoLegalMoves(const Position& p, MoveList& moves)
+{
+  static_assert(Type != GenType::QUIET_CHECKS, "Quiet checks are only generated legally");
+  static constexpr bool  Captures = Type != GenType::QUIETS;
+  static constexpr bool  Quiets   = Type != GenType::CAPTURES;
+  static constexpr Color Enemy    = Player == BLK ? WHT : BLK;
+  BitBoard               self     = getAllBoards<Player>(p);
+  BitBoard               enemy    = getAllBoards<Enemy>(p);
+  BitBoard               all      = self | enemy;
+  BitBoard               empty    = ~all;
+  int                    kingPos  = lsb(getBoard<Player, KNG>(p));
+  BitBoard               targets  = Type == GenType::CAPTURES ? enemy
+                                    : Type == GenType::QUIETS ? empty
+                                                              : ~self;
+  moves.clear();
+  for (BitBoard kmoves = KingMoves[kingPos] & targets; kmoves;) {
+    int dst = pop(kmoves);
+    moves.append(MV_KNG, kingPos, dst);
+  }
+  if constexpr (Quiets) {
+    generatePawnPushMoves<Player, 1>(p, moves, 0, empty, 0, kingPos);
+    generatePawnPushMoves<Player, 2>(p, moves, 0, empty, 0, kingPos);
+    generatePawnPromotionMoves<Player>(p, moves, 0, empty, 0);
+  }
+  if constexpr (Captures) {
+    generatePawnCaptures<Player, NE>(p, moves, 0, enemy, 0, kingPos);
+    generatePawnCaptures<Player, NW>(p, moves, 0, enemy, 0, kingPos);
+    generatePawnCapturePromotions<Player, NE>(p, moves, 0, enemy, 0, kingPos);
+    generatePawnCapturePromotions<Player, NW>(p, moves, 0, enemy, 0, kingPos);
+    generateEnpassant<Player, E>(p, moves, 0, kingPos, all);
+    generateEnpassant<Player, W>(p, moves, 0, kingPos, all);
+  }
+  for (BitBoard pcs = getBoard<Player, HRS>(p); pcs;) {
+    int pos = pop(pcs);
+    for (BitBoard pmoves = KnightMoves[pos] & targets; pmoves;) {
+      int dst = pop(pmoves);
+      moves.append(OTHER, pos, dst);
+    }
+  }
+  generateDiagSlides<Player>(p, moves, 0, all, targets, 0, kingPos);
+  generateOrthoSlides<Player>(p, moves, 0, all, targets, 0, kingPos);
+  if constexpr (Quiets) {
+    // Castling. Only the empty squares are checked here, isLegal checks the safe squares.
+    static constexpr Castle   CastleLong  = Player == WHT ? W_LONG : B_LONG;
+    static constexpr Castle   CastleShort = Player == WHT ? W_SHORT : B_SHORT;
+    static constexpr int      HomeRank    = RelativeRank<Player, 0>;
+    static constexpr BitBoard LongEmpty =
       CastleEmptyMask[std::countr_zero(uint8_t(CastleLong))];
-    static constexpr BitBoard CastleShortSafeMask =
-      CastleSafeMask[std::countr_zero(uint8_t(CastleShort))];
-    static constexpr BitBoard CastleShortEmptyMask =
+    static constexpr BitBoard ShortEmpty =
       CastleEmptyMask[std::countr_zero(uint8_t(CastleShort))];
     Castle rights = p.castlingRights();
-    if ((rights & CastleLong) && !(CastleLongEmptyMask & all) &&
-        !(CastleLongSafeMask & unsafe)) {
-      moves.append(
-        CASTLE_LONG, RelativeRank<Player, 0> * 8 + 4, RelativeRank<Player, 0> * 8 + 2);
+    if ((rights & CastleLong) && !(LongEmpty & all)) {
+      moves.append(CASTLE_LONG, HomeRank * 8 + 4, HomeRank * 8 + 2);
     }
-    if ((rights & CastleShort) && !(CastleShortEmptyMask & all) &&
-        !(CastleShortSafeMask & unsafe)) {
-      moves.append(
-        CASTLE_SHORT, RelativeRank<Player, 0> * 8 + 4, RelativeRank<Player, 0> * 8 + 6);
+    if ((rights & CastleShort) && !(ShortEmpty & all)) {
+      moves.append(CASTLE_SHORT, HomeRank * 8 + 4, HomeRank * 8 + 6);
     }
   }
-  return false;
+  return enemyAttackers<Enemy>(p, kingPos, all);
 }
 
-bool generateMoves(const Position& p, MoveList& moves)
+template<GenType Type>
+bool generatePseudoLegalMoves(const Position& p, MoveList& moves)
 {
   if (p.turn() == WHT) {
-    return generateMoves<WHT>(p, moves);
+    return generatePseudoLegalMoves<WHT, Type>(p, moves);
   }
   else if (p.turn() == BLK) {
-    return generateMoves<BLK>(p, moves);
+    return generatePseudoLegalMoves<BLK, Type>(p, moves);
   }
   return false;
 }
 
+template bool generatePseudoLegalMoves<GenType::ALL>(const Position&, MoveList&);
+template bool generatePseudoLegalMoves<GenType::CAPTURES>(const Position&, MoveList&);
+template bool generatePseudoLegalMoves<GenType::QUIETS>(const Position&, MoveList&);
+
+template<Color Player>
+bool isPseudoLegal(const Position& p, Move m)
+{
+  static constexpr Color     Enemy       = Player == BLK ? WHT : BLK;
+  static constexpr Direction Up          = RelativeDir<N, Player>;
+  static constexpr BitBoard  HomeRank    = Rank[RelativeRank<Player, 1> * 8];
+  static constexpr BitBoard  LastRank    = Rank[RelativeRank<Player, 7> * 8];
+  static constexpr int       KingHome    = RelativeRank<Player, 0> * 8 + 4;
+  static constexpr Castle    CastleLong  = Player == WHT ? W_LONG : B_LONG;
+  static constexpr Castle    CastleShort = Player == WHT ? W_SHORT : B_SHORT;
+  int                        from        = m.from();
+  int                        to          = m.to();
+  if (from >= 64 || to >= 64 || from == to) {
+    return false;
+  }
+  Piece pc     = p.piece(from);
+  Piece victim = p.piece(to);
+  if (pc == NONE || color(pc) != Player || (victim != NONE && color(victim) != Enemy)) {
+    return false;
+  }
+  bool      isCapture = victim != NONE;
+  MoveType  mtype     = m.type();
+  BitBoard  all       = p.occupied();
+  BitBoard  dst       = OneHot[to];
+  PieceType ptype     = type(pc);
+  bool      isPawn    = ptype == PWN;
+  BitBoard  capture   = pawnCapturesFromPos<Player>(from);
+  switch (mtype) {
+  case MV_KNG:
+    return ptype == KNG && (KingMoves[from] & dst);
+  case MV_ROK:
+    return ptype == ROK && (rookMoves(from, all) & dst);
+  case PUSH:
+    return isPawn && !isCapture && to == from + Up && !(dst & LastRank);
+  case DBL_PUSH:
+    return isPawn && !isCapture && (OneHot[from] & HomeRank) && to == from + 2 * Up &&
+           p.piece(from + Up) == NONE;
+  case ENPASSANT:
+    return isPawn && !isCapture && to == p.enpassantSq() && (capture & dst) &&
+           p.piece(to - Up) == (Enemy | PWN);
+  case PRM_HRS:
+  case PRM_BSH:
+  case PRM_ROK:
+  case PRM_QEN:
+    return isPawn && !isCapture && to == from + Up && (dst & LastRank);
+  case PRC_HRS:
+  case PRC_BSH:
+  case PRC_ROK:
+  case PRC_QEN:
+    return isPawn && isCapture && (capture & dst & LastRank);
+  case CASTLE_SHORT:
+    return ptype == KNG && from == KingHome && to == KingHome + 2 &&
+           (p.castlingRights() & CastleShort) &&
+           !(CastleEmptyMask[std::countr_zero(uint8_t(CastleShort))] & all);
+  case CASTLE_LONG:
+    return ptype == KNG && from == KingHome && to == KingHome - 2 &&
+           (p.castlingRights() & CastleLong) &&
+           !(CastleEmptyMask[std::countr_zero(uint8_t(CastleLong))] & all);
+  case OTHER:
+    switch (ptype) {
+    case PWN:  // Pawns only use OTHER for captures that don't promote.
+      return isCapture && (capture & dst) && !(dst & LastRank);
+    case HRS:
+      return KnightMoves[from] & dst;
+    case BSH:
+      return bishopMoves(from, all) & dst;
+    case QEN:
+      return queenMoves(from, all) & dst;
+    default:  // Rooks and kings have their own move types.
+      return false;
+    }
+  default:
+    return false;
+  }
+}
+
+bool isPseudoLegal(const Position& p, Move m)
+{
+  return p.turn() == WHT ? isPseudoLegal<WHT>(p, m) : isPseudoLegal<BLK>(p, m);
+}
+
+template<Color Player>
+bool isLegal(const Position& p, Move m, bool inCheck)
+{
+  static constexpr Color Enemy   = Player == BLK ? WHT : BLK;
+  int                    from    = m.from();
+  int                    to      = m.to();
+  int                    kingPos = lsb(getBoard<Player, KNG>(p));
+  BitBoard               all     = p.occupied();
+  switch (m.type()) {
+  case MV_KNG:
+    // The king is removed, so it can't step back along a checking line.
+    return !enemyAttackers<Enemy>(p, to, all ^ OneHot[from]);
+  case CASTLE_LONG:
+  case CASTLE_SHORT: {
+    Castle   castle = m.type() == CASTLE_LONG ? (Player == WHT ? W_LONG : B_LONG)
+                                              : (Player == WHT ? W_SHORT : B_SHORT);
+    BitBoard safe   = CastleSafeMask[std::countr_zero(uint8_t(castle))];
+    while (safe) {
+      if (enemyAttackers<Enemy>(p, pop(safe), all)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  case ENPASSANT: {
+    int      target   = (from / 8) * 8 + to % 8;
+    BitBoard occupied = (all ^ OneHot[from] ^ OneHot[target]) | OneHot[to];
+    return !(enemyAttackers<Enemy>(p, kingPos, occupied) & ~OneHot[target]);
+  }
+  default: {
+    // The captured piece doesn't attack anymore.
+    BitBoard occupied = (all ^ OneHot[from]) | OneHot[to];
+    BitBoard captured = ~OneHot[to];
+    if (inCheck) {
+      return !(enemyAttackers<Enemy>(p, kingPos, occupied) & captured);
+    }
+    // Only a piece that is lined up with the king can expose it, by leaving the line.
+    BitBoard line = queenMoves(kingPos, 0) & OneHot[from] ? LineMask[kingPos][from] : 0;
+    if (!line || (line & OneHot[to])) {
+      return true;
+    }
+    return !(((bishopMoves(kingPos, occupied) & getBoard<Enemy, BSH, QEN>(p)) |
+              (rookMoves(kingPos, occupied) & getBoard<Enemy, ROK, QEN>(p))) &
+             captured);
+  }
+  }
+}
+
+bool isLegal(const Position& p, Move m, bool inCheck)
+{
+  return p.turn() == WHT ? isLegal<WHT>(p, m, inCheck) : isLegal<BLK>(p, m, inCheck);
+}
+
+bool isLegal(const Position& p, Move m)
+{
+  return isLegal(p, m, p.turn() == WHT ? isInCheck<WHT>(p) : isInCheck<BLK>(p));
+}
+
+/**
+ * @brief Exchange value of a piece type, in the units of MaterialValue.
+ */
+static int seeValue(PieceType type)
+{
+  return type == KNG ? 1000 : MaterialValue[WHT | type];
+}
+
+template<PieceType Type>
+BitBoard typeBoard(const Position& p)
+{
+  return p.board(WHT | Type) | p.board(BLK | Type);
+}
+
+bool seeGE(const Position& p, Move m, int threshold)
+{
+  MoveType mtype = m.type();
+  if (mtype == CASTLE_SHORT || mtype == CASTLE_LONG) {
+    return threshold <= 0;
+  }
+  int       from     = m.from();
+  int       to       = m.to();
+  BitBoard  occupied = ~p.board(NONE) ^ OneHot[from] ^ OneHot[to];
+  PieceType victim   = type(p.piece(to));
+  // The piece standing on the target square after the move, which is the next victim.
+  PieceType mover = type(p.piece(from));
+  if (mtype == ENPASSANT) {
+    victim = PWN;
+    occupied ^= OneHot[(from / 8) * 8 + to % 8];
+  }
+  // Gain relative to the threshold, as the player to move sees it.
+  int swap = seeValue(victim) - threshold;
+  if (mtype >= PRM_HRS && mtype <= PRC_QEN) {
+    mover = PieceType(HRS + (mtype - PRM_HRS) % 4);
+    swap += seeValue(mover) - seeValue(PWN);
+  }
+  if (swap < 0) {
+    return false;
+  }
+  // Gain if the mover is captured right back.
+  swap = seeValue(mover) - swap;
+  if (swap <= 0) {
+    return true;
+  }
+  BitBoard attackers = p.attackersTo(to, occupied);
+  BitBoard diags     = typeBoard<BSH>(p) | typeBoard<QEN>(p);
+  BitBoard orthos    = typeBoard<ROK>(p) | typeBoard<QEN>(p);
+  Color    side      = p.turn();
+  // Flips with every capture. The side that runs out of profitable captures loses.
+  bool result = true;
+  while (true) {
+    side = side == WHT ? BLK : WHT;
+    attackers &= occupied;
+    BitBoard sideAttackers = attackers & p.occupied(side);
+    if (!sideAttackers) {
+      break;
+    }
+    result = !result;
+    // Capture with the least valuable attacker. Removing it may reveal x-ray attackers
+    // behind it, which only sliders on the same line can be.
+    BitBoard bb;
+    if ((bb = sideAttackers & typeBoard<PWN>(p))) {
+      if ((swap = seeValue(PWN) - swap) < int(result)) {
+        break;
+      }
+      occupied ^= OneHot[lsb(bb)];
+      attackers |= bishopMoves(to, occupied) & diags;
+    }
+    else if ((bb = sideAttackers & typeBoard<HRS>(p))) {
+      if ((swap = seeValue(HRS) - swap) < int(result)) {
+        break;
+      }
+      occupied ^= OneHot[lsb(bb)];
+    }
+    else if ((bb = sideAttackers & typeBoard<BSH>(p))) {
+      if ((swap = seeValue(BSH) - swap) < int(result)) {
+        break;
+      }
+      occupied ^= OneHot[lsb(bb)];
+      attackers |= bishopMoves(to, occupied) & diags;
+    }
+    else if ((bb = sideAttackers & typeBoard<ROK>(p))) {
+      if ((swap = seeValue(ROK) - swap) < int(result)) {
+        break;
+      }
+      occupied ^= OneHot[lsb(bb)];
+      attackers |= rookMoves(to, occupied) & orthos;
+    }
+    else if ((bb = sideAttackers & typeBoard<QEN>(p))) {
+      if ((swap = seeValue(QEN) - swap) < int(result)) {
+        break;
+      }
+      occupied ^= OneHot[lsb(bb)];
+      attackers |=
+        (bishopMoves(to, occupied) & diags) | (rookMoves(to, occupied) & orthos);
+    }
+    else {
+      // The king can only capture if the other side has no attackers left.
+      Color other = side == WHT ? BLK : WHT;
+      return (attackers & p.occupied(other)) ? !result : result;
+    }
+  }
+  return result;
+}
+
+template<bool PseudoLegal>
+void generatePerftMoves(const Position& p, MoveList& mlist)
+{
+  if constexpr (PseudoLegal) {
+    bool inCheck = generatePseudoLegalMoves<GenType::ALL>(p, mlist);
+    mlist.resize(size_t(std::distance(
+      mlist.begin(), std::remove_if(mlist.begin(), mlist.end(), [&](Move m) {
+        return !isLegal(p, m, inCheck);
+      }))));
+  }
+  else {
+    generateMoves(p, mlist);
+  }
+}
+
+template<bool PseudoLegal>
 size_t perftInternal(Position& p, int depth)
 {
+  if (depth == 1 && !PseudoLegal) {
+    return countMoves(p);  // Bulk counting, without writing the moves.
+  }
   MoveList mlist;
-  generateMoves(p, mlist);
+  generatePerftMoves<PseudoLegal>(p, mlist);
   if (depth == 1) {
     return mlist.size();
   }
   size_t total = 0;
   for (const auto& m : mlist) {
     m.commit(p);
-    total += perftInternal(p, depth - 1);
+    total += perftInternal<PseudoLegal>(p, depth - 1);
     m.revert(p);
   }
   return total;
 }
 
-void perft(const Position& pOriginal, int depth)
+static size_t perftCopyMake(const Position& p, int depth)
+{
+  if (depth == 1) {
+    return countMoves(p);
+  }
+  MoveList mlist;
+  generateMoves(p, mlist);
+  size_t total = 0;
+  for (const auto& m : mlist) {
+    total += perftCopyMake(m.commitCopy(p), depth - 1);
+  }
+  return total;
+}
+
+void perft(const Position& pOriginal, int depth, bool pseudoLegal, bool copyMake)
 {
-  Position p = pOriginal;
+  using namespace std::chrono;
+  auto     start = steady_clock::now();
+  Position p     = pOriginal;
   MoveList mlist;
   generateMoves(p, mlist);
   size_t total = 0;
   for (const auto& m : mlist) {
     m.commit(p);
-    size_t n = depth == 1 ? 1 : perftInternal(p, depth - 1);
+    size_t n = depth == 1     ? 1
+               : pseudoLegal ? perftInternal<true>(p, depth - 1)
+               : copyMake    ? perftCopyMake(p, depth - 1)
+                             : perftInternal<false>(p, depth - 1);
     std::cout << m << ": " << n << std::endl;
     total += n;
     m.revert(p);
   }
+  double seconds = duration<double>(steady_clock::now() - start).count();
   std::cout << std::endl << "Total: " << total << std::endl;
+  std::cout << "Nodes per second: " << size_t(double(total) / seconds) << std::endl;
 }
 
 Response Response::none()
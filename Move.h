@@ -4,6 +4,7 @@
 #include <Tables.h>
 #include <Util.h>
 #include <stdint.h>
+#include <array>
 #include <bit>
 #include <optional>
 #include <variant>
@@ -56,22 +57,15 @@ enum MoveType : uint8_t
   PRC_QEN      = 12,  // r
   CASTLE_SHORT = 13,  // c
   CASTLE_LONG  = 14,  // c
-  OTHER        = 15,  // Move with knight, bishop or queen.
-  CAPTURE      = 16,  // This is used as a mask on other moves.
-  // Eventhough enpassant is a capture, this mask is not used for that, as it is handled
-  // seprately.
+  OTHER        = 15,  // Move with knight, bishop or queen, or a pawn capture.
+  // Captures are not flagged in the move type. Use Move::isCapture with the position.
 };
 
-constexpr inline MoveType operator|(MoveType a, MoveType b)
-{
-  return MoveType(uint8_t(a) | b);
-}
-
-constexpr inline MoveType operator&(MoveType a, MoveType b)
-{
-  return MoveType(uint8_t(a) & b);
-}
-
+/**
+ * @brief A move packed into 16 bits: the from square in bits 0-5, the to square in bits
+ * 6-11 and the move type in bits 12-15. The default move has both squares on a8, which
+ * no real move has, so it can stand for no move.
+ */
 struct Move
 {
   Move() = default;
@@ -80,27 +74,70 @@ struct Move
   MoveType type() const;
   int      from() const;
   int      to() const;
+  /**
+   * @brief Check if the move captures a piece, including enpassant. This must be called
+   * before the move is committed.
+   */
+  bool     isCapture(const Position& p) const;
   void     commit(Position& p) const;
   void     revert(Position& p) const;
+  /**
+   * @brief Copy-make version of commit. This returns the position after the move and
+   * leaves the given position as it is, so there is nothing to revert. The copy starts
+   * without undo records, so repetitions before it are not detected.
+   */
+  Position commitCopy(const Position& p) const;
   /**
    * @brief Long algebraic notation of the move.
    *
    * @return std::string
    */
   std::string algebraic() const;
-  bool        operator==(const Move&);
-  bool        operator!=(const Move&);
+  bool        operator==(const Move&) const;
+  bool        operator!=(const Move&) const;
 
 private:
-  MoveType mType = OTHER;
-  uint8_t  mFrom = UINT8_MAX;
-  uint8_t  mTo   = UINT8_MAX;
+  uint16_t mData = 0;
 };
+static_assert(sizeof(Move) == 2, "Moves are expected to be packed into 16 bits");
 
 struct MoveList : public StaticVector<Move, 256>
 {
 public:
-  void append(MoveType type, int from, int to, bool isCapture = false);
+  void append(MoveType type, int from, int to);
+  /**
+   * @brief Add the moves of a piece to each of the target squares.
+   */
+  void addMoves(MoveType type, int from, BitBoard targets);
+  /**
+   * @brief Add pawn moves to each of the target squares, from the square that is
+   * `offset` behind the target.
+   */
+  void addPawnMoves(MoveType type, int offset, BitBoard targets);
+  /**
+   * @brief Add the four promotions to each of the target squares, starting with the
+   * given knight promotion type.
+   */
+  void addPromotions(MoveType knight, int offset, BitBoard targets);
+};
+
+/**
+ * @brief Takes the place of a MoveList in the move generator, to count the moves without
+ * writing them. The targets are counted with a popcount per piece, or per pawn push and
+ * capture direction.
+ */
+struct MoveCounter
+{
+public:
+  void   clear();
+  size_t size() const;
+  void   append(MoveType type, int from, int to);
+  void   addMoves(MoveType type, int from, BitBoard targets);
+  void   addPawnMoves(MoveType type, int offset, BitBoard targets);
+  void   addPromotions(MoveType knight, int offset, BitBoard targets);
+
+private:
+  size_t mCount = 0;
 };
 
 int      pop(BitBoard& b);
@@ -108,6 +145,77 @@ int      lsb(BitBoard b);
 BitBoard bishopMoves(int sq, BitBoard blockers);
 BitBoard rookMoves(int sq, BitBoard blockers);
 BitBoard queenMoves(int sq, BitBoard blockers);
+/**
+ * @brief Get the squares attacked by a set of pawns of the given color.
+ */
+BitBoard pawnAttacks(Color c, BitBoard pawns);
+/**
+ * @brief Get the squares attacked by a set of sliders, for all eight directions at once,
+ * using occluded fills. This uses AVX2 when the CPU supports it.
+ *
+ * @param diagonal Sliders that move along diagonals, i.e. bishops and queens.
+ * @param orthogonal Sliders that move along ranks and files, i.e. rooks and queens.
+ * @param empty Squares the sliders can move through.
+ * @return BitBoard
+ */
+BitBoard sliderAttackFill(BitBoard diagonal, BitBoard orthogonal, BitBoard empty);
+enum struct GenType
+{
+  ALL      = 0,  // All legal moves.
+  CAPTURES = 1,  // Captures, including capture-promotions and enpassant.
+  QUIETS   = 2,  // Non captures, including promotions and castling.
+  // Quiet moves that give check, directly or by discovery. This is meant for positions
+  // that are not in check. In check, the quiet evasions that give check are generated.
+  QUIET_CHECKS = 3,
+};
+
+/**
+ * @brief Data the move generator computes along the way, for the player to move. The
+ * enemy attacks are computed with the player's king removed from the blockers, like the
+ * generator does to find the squares the king can't move to.
+ */
+struct MoveGenInfo
+{
+  BitBoard mUnsafe            = 0;  // All squares attacked by the enemy.
+  BitBoard mPinned            = 0;  // Player's pieces pinned to their king.
+  BitBoard mCheckers          = 0;  // Enemy pieces giving check.
+  BitBoard mPawnAttacks       = 0;  // Squares attacked by enemy pawns.
+  BitBoard mKnightAttacks     = 0;  // Squares attacked by enemy knights.
+  BitBoard mDiagonalAttacks   = 0;  // Squares attacked by enemy bishops and queens.
+  BitBoard mOrthogonalAttacks = 0;  // Squares attacked by enemy rooks and queens.
+  BitBoard mKingAttacks       = 0;  // Squares attacked by the enemy king.
+};
+
+/**
+ * @brief Generate legal moves of the given type for the position.
+ *
+ * @tparam Type The kind of moves to generate.
+ * @param p The position.
+ * @param moves Legal moves will be written to this list. Previous contents will be
+ * erased.
+ * @return bool Flag indicating if the player's king is in check. This may be used to
+ * identify checkmate / stalemate.
+ */
+template<GenType Type>
+bool generateMoves(const Position& p, MoveList& moves);
+/**
+ * @brief Generate legal moves, and also report the attack maps, pins and checkers that
+ * were computed to generate them. The slider attacks are split by direction here, which
+ * costs an extra attack fill.
+ *
+ * @param info Written with the data of the generation pass.
+ */
+template<GenType Type>
+bool generateMoves(const Position& p, MoveList& moves, MoveGenInfo& info);
+bool generateMoves(const Position& p, MoveList& moves, MoveGenInfo& info);
+/**
+ * @brief Count the legal moves of the given type, without writing them to a list.
+ *
+ * @tparam Type The kind of moves to count. QUIET_CHECKS is not supported.
+ */
+template<GenType Type>
+size_t countMoves(const Position& p);
+size_t countMoves(const Position& p);
 /**
  * @brief Generate legal moves for the position.
  *
@@ -118,7 +226,88 @@ BitBoard queenMoves(int sq, BitBoard blockers);
  * identify checkmate / stalemate.
  */
 bool generateMoves(const Position& p, MoveList& moves);
-void perft(const Position& p, int depth);
+/**
+ * @brief Generate pseudo-legal moves of the given type for the position. These follow the
+ * movement rules of the pieces but may leave the player's king in check. This skips the
+ * pins, checkers and unsafe squares that generateMoves computes, so it is cheaper when
+ * only a few of the moves are tried. Each move must pass isLegal before it is played.
+ *
+ * @tparam Type The kind of moves to generate. QUIET_CHECKS is not supported.
+ * @param p The position.
+ * @param moves Pseudo-legal moves will be written to this list. Previous contents will be
+ * erased.
+ * @return bool Flag indicating if the player's king is in check.
+ */
+template<GenType Type>
+bool generatePseudoLegalMoves(const Position& p, MoveList& moves);
+/**
+ * @brief Check if a move can be played in the position, following the movement rules of
+ * the pieces, i.e. if generatePseudoLegalMoves would generate it. This works for any
+ * move, including hash and killer moves from other positions, in constant time.
+ */
+bool isPseudoLegal(const Position& p, Move m);
+/**
+ * @brief Check if a pseudo-legal move leaves the player's king safe. Together with
+ * isPseudoLegal, this validates a stored move without generating the move list.
+ *
+ * @param p The position.
+ * @param m A pseudo-legal move.
+ * @param inCheck Flag indicating if the player's king is in check. When it isn't, only
+ * king moves, castling, enpassant and moves of pieces lined up with the king need attack
+ * lookups.
+ */
+bool isLegal(const Position& p, Move m, bool inCheck);
+bool isLegal(const Position& p, Move m);
+/**
+ * @brief Precomputed data to tell if the player's moves give check, without committing
+ * them. Computing it costs two slider lookups, so it is worth sharing between the moves
+ * of a position.
+ */
+struct CheckInfo
+{
+  // Squares from which each piece type attacks the enemy king, indexed by piece type. The
+  // king can't give check directly.
+  std::array<BitBoard, 7> mSquares     = {};
+  // Player's pieces that are the only blocker between one of the player's sliders and the
+  // enemy king. These give a discovered check when they move off that line.
+  BitBoard                mDiscoverers = 0;
+  int                     mKingPos     = 0;
+
+  static CheckInfo fromPosition(const Position& p);
+};
+
+/**
+ * @brief Check if a legal move gives check, without committing it. This handles direct
+ * and discovered checks, promotions, castling and enpassant.
+ *
+ * @param p The position, before the move.
+ * @param m The move.
+ * @param ci Check info for the position.
+ */
+bool givesCheck(const Position& p, Move m, const CheckInfo& ci);
+bool givesCheck(const Position& p, Move m);
+/**
+ * @brief Static exchange evaluation. Both sides take turns capturing on the target square
+ * of the move with their least valuable attacker, and either side may stop when a
+ * capture would lose material. Sliders revealed behind the attackers join in as they are
+ * uncovered. Pins are ignored.
+ *
+ * @param p The position, before the move.
+ * @param m The move.
+ * @param threshold In the units of MaterialValue.
+ * @return bool Flag indicating if the exchange gains at least the threshold for the
+ * player to move.
+ */
+bool seeGE(const Position& p, Move m, int threshold);
+/**
+ * @brief Count the leaf nodes at the given depth, and print the count for each move.
+ *
+ * @param pseudoLegal Use pseudo-legal generation with lazy legality checks, instead of
+ * the legal move generator.
+ * @param copyMake Copy the position for each move with Move::commitCopy, instead of
+ * committing and reverting the moves. Not combined with pseudoLegal.
+ */
+void perft(const Position& p, int depth, bool pseudoLegal = false, bool copyMake = false);
 
 template<Color Player, PieceType... Types>
 BitBoard getBoard(const Position& p)
@@ -129,7 +318,7 @@ BitBoard getBoard(const Position& p)
 template<Color Player>
 BitBoard getAllBoards(const Position& p)
 {
-  return getBoard<Player, PWN, HRS, BSH, ROK, QEN, KNG>(p);
+  return p.occupied(Player);
 }
 
 enum struct Conclusion
@@ -148,6 +337,61 @@ struct Response
   bool            isNone() const;
 };
 
+/**
+ * @brief Yields the legal moves of a position in stages: the hash move first, then
+ * captures ordered by MVV-LVA with the ones that lose material by SEE last, and then the
+ * quiet moves. Stages are only generated when they are reached, and moves are picked one
+ * at a time by partial selection instead of sorting the whole list. Nodes that cut off
+ * early skip most of the work.
+ */
+class MovePicker
+{
+public:
+  /**
+   * @brief Create a move picker.
+   *
+   * @param p The position. It must outlive the picker and not be modified while moves
+   * are being picked.
+   * @param hashMove This move is tried first, if it is legal.
+   */
+  explicit MovePicker(const Position& p, Move hashMove = Move());
+  /**
+   * @brief Get the next move.
+   *
+   * @param m The move is written here.
+   * @return bool false if there are no more moves.
+   */
+  bool next(Move& m);
+  /**
+   * @brief Flag indicating if the player's king is in check. This is only valid after
+   * next() returned false, i.e. after all the moves were picked.
+   */
+  bool inCheck() const;
+
+private:
+  enum struct Stage
+  {
+    HASH,
+    GEN_CAPTURES,
+    CAPTURES,
+    GEN_QUIETS,
+    QUIETS,
+    DONE,
+  };
+
+  template<GenType Type>
+  void generate();
+  bool pick(Move& m);
+
+  const Position&                 mPosition;
+  Move                            mHashMove;
+  Stage                           mStage   = Stage::HASH;
+  bool                            mInCheck = false;
+  MoveList                        mMoves;
+  std::array<int, MoveList::Size> mScores;
+  size_t                          mCurrent = 0;
+};
+
 Response bestMove(Position& p);
 
 }  // namespace potato
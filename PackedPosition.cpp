@@ -0,0 +1,193 @@
+#include <PackedPosition.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <Move.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace potato {
+
+// Number of records the file of a writer grows by, 1 MiB.
+static constexpr size_t WriterChunk = (size_t(1) << 20) / sizeof(PackedPosition);
+
+[[noreturn]] static void systemError(const std::string& what)
+{
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+PackedPosition PackedPosition::encode(const Position& p)
+{
+  PackedPosition packed = {};
+  packed.mOccupied      = p.occupied();
+  if (std::popcount(packed.mOccupied) > 32) {
+    throw std::logic_error("Positions with more than 32 pieces can't be packed");
+  }
+  int i = 0;
+  for (BitBoard occupied = packed.mOccupied; occupied; ++i) {
+    packed.mPieces[i / 2] |= uint8_t(p.piece(pop(occupied)) << (4 * (i % 2)));
+  }
+  packed.mMoveCount       = uint16_t(p.moveCount());
+  packed.mHalfMoveCount   = uint8_t(p.halfMoveCount());
+  packed.mEnPassantSquare = int8_t(p.enpassantSq());
+  packed.mTurn            = p.turn();
+  packed.mCastlingRights  = p.castlingRights();
+  return packed;
+}
+
+Position PackedPosition::decode() const
+{
+  if (std::popcount(mOccupied) > 32) {
+    throw std::runtime_error("Packed position has more than 32 pieces");
+  }
+  // The en passant square is behind a pawn that just moved two squares, on rank 3 or 6.
+  int enpassantRank = mEnPassantSquare >> 3;
+  if (mEnPassantSquare != -1 &&
+      (mEnPassantSquare < 0 || (enpassantRank != 2 && enpassantRank != 5))) {
+    throw std::runtime_error("Packed position has an invalid en passant square");
+  }
+  if (mCastlingRights > 0xf) {
+    throw std::runtime_error("Packed position has invalid castling rights");
+  }
+  if (mTurn != BLK && mTurn != WHT) {
+    throw std::runtime_error("Packed position has an invalid turn");
+  }
+  Position p = Position::empty();
+  int      i = 0;
+  for (BitBoard occupied = mOccupied; occupied; ++i) {
+    Piece pc = Piece((mPieces[i / 2] >> (4 * (i % 2))) & 0xf);
+    // Occupied squares can't be empty, and 7, 8 and 15 are not pieces.
+    if (type(pc) == 0 || type(pc) == 7) {
+      throw std::runtime_error("Packed position has an invalid piece");
+    }
+    p.put(pop(occupied), pc);
+  }
+  p.setMoveCount(mMoveCount);
+  p.setHalfMoveCount(mHalfMoveCount);
+  p.setEnpassantSq(mEnPassantSquare);
+  p.setTurn(Color(mTurn));
+  p.setCastlingRights(Castle(mCastlingRights));
+  return p;
+}
+
+PackedWriter::PackedWriter(const fs::path& path)
+    : mFd(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644))
+{
+  if (mFd == -1) {
+    systemError("Cannot open " + path.string());
+  }
+}
+
+PackedWriter::~PackedWriter()
+{
+  if (mData) {
+    ::munmap(mData, mCapacity * sizeof(PackedPosition));
+  }
+  // Drop the unused part of the last chunk.
+  if (::ftruncate(mFd, off_t(mSize * sizeof(PackedPosition))) != 0) {
+    std::cerr << "Failed to truncate the packed positions file\n";
+  }
+  ::close(mFd);
+}
+
+void PackedWriter::write(const Position& p)
+{
+  write(PackedPosition::encode(p));
+}
+
+void PackedWriter::write(const PackedPosition& packed)
+{
+  if (mSize == mCapacity) {
+    grow();
+  }
+  mData[mSize++] = packed;
+}
+
+size_t PackedWriter::size() const
+{
+  return mSize;
+}
+
+void PackedWriter::grow()
+{
+  size_t capacity = mCapacity + WriterChunk;
+  if (::ftruncate(mFd, off_t(capacity * sizeof(PackedPosition))) != 0) {
+    systemError("Cannot grow the packed positions file");
+  }
+  if (mData) {
+    ::munmap(mData, mCapacity * sizeof(PackedPosition));
+    mData = nullptr;
+  }
+  void* data = ::mmap(nullptr,
+                      capacity * sizeof(PackedPosition),
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      mFd,
+                      0);
+  if (data == MAP_FAILED) {
+    systemError("Cannot map the packed positions file");
+  }
+  mData     = static_cast<PackedPosition*>(data);
+  mCapacity = capacity;
+}
+
+PackedReader::PackedReader(const fs::path& path)
+    : mFd(::open(path.c_str(), O_RDONLY))
+{
+  if (mFd == -1) {
+    systemError("Cannot open " + path.string());
+  }
+  struct stat info;
+  if (::fstat(mFd, &info) != 0) {
+    ::close(mFd);
+    systemError("Cannot read the size of " + path.string());
+  }
+  if (info.st_size % sizeof(PackedPosition)) {
+    ::close(mFd);
+    throw std::runtime_error("The size of " + path.string() +
+                             " is not a multiple of the packed position size");
+  }
+  mSize = size_t(info.st_size) / sizeof(PackedPosition);
+  if (mSize) {
+    void* data = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, mFd, 0);
+    if (data == MAP_FAILED) {
+      ::close(mFd);
+      systemError("Cannot map " + path.string());
+    }
+    ::madvise(data, size_t(info.st_size), MADV_SEQUENTIAL);
+    mData = static_cast<const PackedPosition*>(data);
+  }
+}
+
+PackedReader::~PackedReader()
+{
+  if (mData) {
+    ::munmap(const_cast<PackedPosition*>(mData), mSize * sizeof(PackedPosition));
+  }
+  ::close(mFd);
+}
+
+size_t PackedReader::size() const
+{
+  return mSize;
+}
+
+std::span<const PackedPosition> PackedReader::records() const
+{
+  return std::span<const PackedPosition>(mData, mSize);
+}
+
+bool PackedReader::next(Position& p)
+{
+  if (mNext == mSize) {
+    return false;
+  }
+  p = mData[mNext++].decode();
+  return true;
+}
+
+}  // namespace potato
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Position.h>
+#include <Util.h>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+namespace potato {
+
+/**
+ * @brief A position packed into 32 bytes, for storing large numbers of positions. The
+ * occupied squares are stored as a bitboard, followed by one 4-bit piece per occupied
+ * square in the order of the squares, two to a byte with the first in the low nibble.
+ * The rest of the state that fen() writes follows. Positions with more than 32 pieces
+ * can't be packed, and decode() throws std::runtime_error on corrupt records.
+ */
+struct PackedPosition
+{
+  uint64_t                mOccupied;
+  std::array<uint8_t, 16> mPieces;
+  uint16_t                mMoveCount;
+  uint8_t                 mHalfMoveCount;
+  int8_t                  mEnPassantSquare;
+  uint8_t                 mTurn;
+  uint8_t                 mCastlingRights;
+  std::array<uint8_t, 2>  mReserved;  // Always zero, so equal positions have equal bytes.
+
+  static PackedPosition encode(const Position& p);
+  Position              decode() const;
+};
+static_assert(sizeof(PackedPosition) == 32,
+              "Packed positions are expected to be 32 bytes");
+static_assert(std::is_trivially_copyable_v<PackedPosition>,
+              "Packed positions are written to files as raw bytes");
+static_assert(std::endian::native == std::endian::little,
+              "The packed file format is little-endian");
+
+/**
+ * @brief Writes packed positions to a file through a memory mapping. The file is grown in
+ * chunks as positions are written, and cut to the written size when the writer is
+ * destroyed.
+ */
+class PackedWriter
+{
+public:
+  explicit PackedWriter(const fs::path& path);
+  ~PackedWriter();
+  PackedWriter(const PackedWriter&)            = delete;
+  PackedWriter& operator=(const PackedWriter&) = delete;
+
+  void   write(const Position& p);
+  void   write(const PackedPosition& packed);
+  size_t size() const;
+
+private:
+  void grow();
+
+  int             mFd       = -1;
+  PackedPosition* mData     = nullptr;
+  size_t          mSize     = 0;
+  size_t          mCapacity = 0;
+};
+
+/**
+ * @brief Reads packed positions from a memory mapped file. The records can be accessed
+ * directly, or decoded one by one with next().
+ */
+class PackedReader
+{
+public:
+  explicit PackedReader(const fs::path& path);
+  ~PackedReader();
+  PackedReader(const PackedReader&)            = delete;
+  PackedReader& operator=(const PackedReader&) = delete;
+
+  size_t                          size() const;
+  std::span<const PackedPosition> records() const;
+  /**
+   * @brief Decode the next position of the file.
+   *
+   * @return bool False if all the positions were read, in which case p is not modified.
+   */
+  bool next(Position& p);
+
+private:
+  int                   mFd   = -1;
+  const PackedPosition* mData = nullptr;
+  size_t                mSize = 0;
+  size_t                mNext = 0;
+};
+
+}  // namespace potato
@@ -1,8 +1,10 @@
 #include <Move.h>
 #include <algorithm>
+#include <cassert>
 #include <glm/fwd.hpp>
+#include <charconv>
+#include <limits>
 #include <ostream>
-#include <regex>
 
 #include <iostream>
 
@@ -57,40 +59,126 @@ Position::Position()
         {63, Piece::W_ROK}}});
 }
 
-using ZobristTable = std::array<uint64_t, NUniquePieces * 64>;
+/**
+ * @brief Zobrist keys for the piece on each square, the castling rights, the file of the
+ * enpassant square and the side to move. They are generated at compile time from a fixed
+ * seed, so the hashes are the same in every run and every build. The material keys are
+ * indexed by piece and by how many of that piece were on the board before it. There is
+ * room for 64 of each, so any board that put() can build has keys.
+ */
+struct ZobristKeys
+{
+  static constexpr size_t MaxPieceCount = 64;
+
+  std::array<uint64_t, NUniquePieces * 64>            mPieces;
+  std::array<uint64_t, 16>                            mCastling;
+  std::array<uint64_t, 8>                             mEnpassant;
+  uint64_t                                            mBlackToMove;
+  std::array<uint64_t, NUniquePieces * MaxPieceCount> mMaterial;
+};
+
+static constexpr uint64_t splitMix64(uint64_t& state)
+{
+  uint64_t z = (state += 0x9e3779b97f4a7c15);
+  z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z          = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
 
-static ZobristTable generateZobristTable()
+static constexpr ZobristKeys generateZobristKeys()
 {
-  std::array<uint64_t, NUniquePieces * 64> table;
-  for (uint64_t pc = 0; pc < NUniquePieces; ++pc) {
-    for (uint64_t pos = 0; pos < 64; ++pos) {
-      table[pc * 64 + pos] = uint64_t(std::rand()) | (uint64_t(std::rand()) << 32);
+  ZobristKeys keys  = {};
+  uint64_t    state = 0x70329434d587dc75;  // seed.
+  for (size_t pc = 0; pc < NUniquePieces; ++pc) {
+    for (size_t pos = 0; pos < 64; ++pos) {
+      // Empty squares don't contribute to the hash.
+      keys.mPieces[pc * 64 + pos] = pc == NONE ? 0 : splitMix64(state);
     }
   }
-  return table;
+  // Combinations of castling rights get the xor of the keys of the individual rights, so
+  // revoking a right is a single xor.
+  std::array<uint64_t, 4> rights = {};
+  for (auto& key : rights) {
+    key = splitMix64(state);
+  }
+  for (size_t c = 0; c < keys.mCastling.size(); ++c) {
+    for (size_t i = 0; i < rights.size(); ++i) {
+      keys.mCastling[c] ^= (c & (1 << i)) ? rights[i] : 0;
+    }
+  }
+  for (auto& key : keys.mEnpassant) {
+    key = splitMix64(state);
+  }
+  keys.mBlackToMove = splitMix64(state);
+  // The keys of NONE, which come first, are left at zero.
+  for (size_t i = ZobristKeys::MaxPieceCount; i < keys.mMaterial.size(); ++i) {
+    keys.mMaterial[i] = splitMix64(state);
+  }
+  return keys;
 }
 
-static const ZobristTable& zobristTable()
+static constexpr ZobristKeys Zobrist = generateZobristKeys();
+
+static constexpr uint64_t enpassantKey(int enp)
+{
+  return enp == -1 ? 0 : Zobrist.mEnpassant[enp % 8];
+}
+
+static constexpr uint64_t pawnKey(Piece pc, int pos)
+{
+  return type(pc) == PWN ? Zobrist.mPieces[pc * 64 + pos] : 0;
+}
+
+/**
+ * @brief Key of the n-th piece of the given kind, counting from zero.
+ */
+static constexpr uint64_t materialKey(Piece pc, int n)
 {
-  static const ZobristTable sTable = generateZobristTable();
-  return sTable;
+  return Zobrist.mMaterial[pc * ZobristKeys::MaxPieceCount + n];
 }
 
 void Position::calcHash()
 {
-  mHash = 0x70329434d587dc75;  // seed.
+  State& state    = mState;
+  state.mHash     = 0;
+  state.mPawnHash = 0;
   for (int i = 0; i < 64; ++i) {
-    mHash ^= zobristTable()[mPieces[i] * 64 + i];
+    state.mHash ^= Zobrist.mPieces[mPieces[i] * 64 + i];
+    state.mPawnHash ^= pawnKey(mPieces[i], i);
+  }
+  state.mHash ^= Zobrist.mCastling[castlingRights()];
+  state.mHash ^= enpassantKey(enpassantSq());
+  state.mHash ^= mTurn == BLK ? Zobrist.mBlackToMove : 0;
+  state.mMaterialHash = 0;
+  for (size_t pc = 1; pc < NUniquePieces; ++pc) {
+    for (int n = 0; n < std::popcount(mBitBoards[pc]); ++n) {
+      state.mMaterialHash ^= materialKey(Piece(pc), n);
+    }
   }
 }
 
 Position& Position::put(int pos, Piece pc)
 {
-  Piece    old  = std::exchange(mPieces[pos], pc);
-  BitBoard mask = OneHot[pos];
+  Piece old = mPieces[pos];
+  if (old == pc) {
+    return *this;
+  }
+  mPieces[pos]   = pc;
+  BitBoard mask  = OneHot[pos];
+  State&   state = mState;
   mBitBoards[old] &= ~mask;
   mBitBoards[pc] |= mask;
-  mHash ^= zobristTable()[old * 64 + pos] ^ zobristTable()[pc * 64 + pos];
+  // Empty squares are not counted in the material key.
+  if (old != NONE) {
+    mColorBoards[color(old) >> 3] &= ~mask;
+    state.mMaterialHash ^= materialKey(old, std::popcount(mBitBoards[old]));
+  }
+  if (pc != NONE) {
+    mColorBoards[color(pc) >> 3] |= mask;
+    state.mMaterialHash ^= materialKey(pc, std::popcount(mBitBoards[pc]) - 1);
+  }
+  state.mHash ^= Zobrist.mPieces[old * 64 + pos] ^ Zobrist.mPieces[pc * 64 + pos];
+  state.mPawnHash ^= pawnKey(old, pos) ^ pawnKey(pc, pos);
   mMaterial += MaterialValue[pc] - MaterialValue[old];
   return *this;
 }
@@ -120,8 +208,21 @@ Position& Position::remove(glm::ivec2 pos)
 
 Position& Position::move(int from, int to)
 {
-  Piece pc = mPieces[from];
-  return remove(from).put(to, pc);
+  if (mPieces[to] != NONE) {
+    remove(to);
+  }
+  // Moving to an empty square leaves the material as it is, so only the placement and
+  // the keys that depend on it need to be updated.
+  Piece    pc   = std::exchange(mPieces[from], NONE);
+  BitBoard mask = OneHot[from] | OneHot[to];
+  mPieces[to]   = pc;
+  mBitBoards[pc] ^= mask;
+  mBitBoards[NONE] ^= mask;
+  mColorBoards[color(pc) >> 3] ^= mask;
+  State& state = mState;
+  state.mHash ^= Zobrist.mPieces[pc * 64 + from] ^ Zobrist.mPieces[pc * 64 + to];
+  state.mPawnHash ^= pawnKey(pc, from) ^ pawnKey(pc, to);
+  return *this;
 }
 
 Position& Position::move(glm::ivec2 from, glm::ivec2 to)
@@ -144,34 +245,77 @@ BitBoard Position::board(Piece p) const
   return mBitBoards[p];
 }
 
+BitBoard Position::occupied() const
+{
+  return ~mBitBoards[NONE];
+}
+
+BitBoard Position::occupied(Color c) const
+{
+  return mColorBoards[c >> 3];
+}
+
+BitBoard Position::attackersTo(int sq, BitBoard occupied) const
+{
+  return attackersTo(WHT, sq, occupied) | attackersTo(BLK, sq, occupied);
+}
+
+BitBoard Position::attackersTo(Color c, int sq, BitBoard occupied) const
+{
+  // A pawn attacks the square if a pawn of the other color on the square would attack it.
+  const auto& pawnCaptures = c == WHT ? BlackPawnCaptures : WhitePawnCaptures;
+  return (pawnCaptures[sq] & mBitBoards[c | PWN]) |
+         (KnightMoves[sq] & mBitBoards[c | HRS]) | (KingMoves[sq] & mBitBoards[c | KNG]) |
+         (bishopMoves(sq, occupied) & (mBitBoards[c | BSH] | mBitBoards[c | QEN])) |
+         (rookMoves(sq, occupied) & (mBitBoards[c | ROK] | mBitBoards[c | QEN]));
+}
+
+BitBoard Position::attacks(Color c) const
+{
+  BitBoard out = pawnAttacks(c, mBitBoards[c | PWN]);
+  for (BitBoard knights = mBitBoards[c | HRS]; knights;) {
+    out |= KnightMoves[pop(knights)];
+  }
+  if (mBitBoards[c | KNG]) {
+    out |= KingMoves[lsb(mBitBoards[c | KNG])];
+  }
+  return out | sliderAttackFill(mBitBoards[c | BSH] | mBitBoards[c | QEN],
+                                mBitBoards[c | ROK] | mBitBoards[c | QEN],
+                                mBitBoards[NONE]);
+}
+
 int Position::enpassantSq() const
 {
-  return mState.back().mEnPassantSquare;
+  return mState.mEnPassantSquare;
 }
 
 Castle Position::castlingRights() const
 {
-  return mState.back().mCastlingRights;
+  return mState.mCastlingRights;
 }
 
 void Position::setEnpassantSq(int enp)
 {
-  mState.back().mEnPassantSquare = enp;
+  State& state = mState;
+  state.mHash ^= enpassantKey(state.mEnPassantSquare) ^ enpassantKey(enp);
+  state.mEnPassantSquare = enp;
 }
 
 void Position::unsetEnpassantSq()
 {
-  mState.back().mEnPassantSquare = -1;
+  setEnpassantSq(-1);
 }
 
 void Position::setCastlingRights(Castle c)
 {
-  mState.back().mCastlingRights = c;
+  State& state = mState;
+  state.mHash ^= Zobrist.mCastling[state.mCastlingRights] ^ Zobrist.mCastling[c];
+  state.mCastlingRights = c;
 }
 
 void Position::revokeCastlingRights(Castle c)
 {
-  mState.back().mCastlingRights = Castle(mState.back().mCastlingRights & ~c);
+  setCastlingRights(Castle(mState.mCastlingRights & ~c));
 }
 
 Color Position::turn() const
@@ -181,12 +325,15 @@ Color Position::turn() const
 
 void Position::setTurn(Color turn)
 {
-  mTurn = turn;
+  if (turn != mTurn) {
+    switchTurn();
+  }
 }
 
 void Position::switchTurn()
 {
   mTurn = Color(mTurn ^ WHT);
+  mState.mHash ^= Zobrist.mBlackToMove;
 }
 
 void Position::clear()
@@ -194,15 +341,25 @@ void Position::clear()
   std::fill(mPieces.begin(), mPieces.end(), Piece::NONE);
   std::fill(mBitBoards.begin(), mBitBoards.end(), 0);
   mBitBoards[Piece::NONE] = 0xffffffffffffffff;  // All squares contain the NONE piece.
-  mState.clear();
-  mState.push_back(State());
+  std::fill(mColorBoards.begin(), mColorBoards.end(), 0);
+  mState = State();
   mTurn = Color::WHT;
   calcHash();
 }
 
 size_t Position::hash() const
 {
-  return mHash;
+  return mState.mHash;
+}
+
+uint64_t Position::pawnHash() const
+{
+  return mState.mPawnHash;
+}
+
+uint64_t Position::materialHash() const
+{
+  return mState.mMaterialHash;
 }
 
 int Position::material() const
@@ -213,11 +370,11 @@ int Position::material() const
 bool Position::operator==(const Position& other) const
 {
   return mPieces == other.mPieces && mBitBoards == other.mBitBoards &&
-         /*mState == other.mState &&*/ mHash == other.mHash &&
-         mState.back().mHalfMoveCount == other.mState.back().mHalfMoveCount &&
-         mState.back().mMoveCount == other.mState.back().mMoveCount &&
-         mState.back().mEnPassantSquare == other.mState.back().mEnPassantSquare &&
-         mState.back().mCastlingRights == other.mState.back().mCastlingRights &&
+         /*mState == other.mState &&*/ hash() == other.hash() &&
+         mState.mHalfMoveCount == other.mState.mHalfMoveCount &&
+         mState.mMoveCount == other.mState.mMoveCount &&
+         mState.mEnPassantSquare == other.mState.mEnPassantSquare &&
+         mState.mCastlingRights == other.mState.mCastlingRights &&
          mTurn == other.mTurn;
 }
 
@@ -228,9 +385,14 @@ bool Position::operator!=(const Position& other) const
 
 Position Position::empty()
 {
-  Position p;
-  p.clear();
-  return p;
+  // Copied from a cached board, because setting up and clearing the starting position
+  // dominates the cost of loading positions in bulk.
+  static const Position sEmpty = [] {
+    Position p;
+    p.clear();
+    return p;
+  }();
+  return sEmpty;
 }
 
 int fileToX(char file)
@@ -281,299 +443,384 @@ int rankToY(char rank)
   }
 }
 
-using SubMatch = std::sub_match<std::string::const_iterator>;
-static void parsePlacement(const SubMatch& placement, Position& b)
+[[noreturn]] static void fenError(const char* field, size_t pos)
 {
-  int pos = 0;
-  // auto       shift = [&pos](int offset = 1) {
-  //   int flat = pos.x + 8 * pos.y;
-  //   flat += offset;
-  //   pos = {flat % 8, flat / 8};
-  // };
-  for (auto it = placement.first; it != placement.second; ++it) {
-    char c = *it;
-    switch (c) {
-    case 'p':
-      b.put(pos, B_PWN);
-      ++pos;
-      break;
-    case 'n':
-      b.put(pos, B_HRS);
-      ++pos;
-      break;
-    case 'b':
-      b.put(pos, B_BSH);
-      ++pos;
-      break;
-    case 'r':
-      b.put(pos, B_ROK);
-      ++pos;
-      break;
-    case 'q':
-      b.put(pos, B_QEN);
-      ++pos;
-      break;
-    case 'k':
-      b.put(pos, B_KNG);
-      ++pos;
-      break;
-    case 'P':
-      b.put(pos, W_PWN);
-      ++pos;
-      break;
-    case 'N':
-      b.put(pos, W_HRS);
-      ++pos;
-      break;
-    case 'B':
-      b.put(pos, W_BSH);
-      ++pos;
-      break;
-    case 'R':
-      b.put(pos, W_ROK);
-      ++pos;
-      break;
-    case 'Q':
-      b.put(pos, W_QEN);
-      ++pos;
-      break;
-    case 'K':
-      b.put(pos, W_KNG);
-      ++pos;
-      break;
-    case '/':
-      if (pos % 8) {
-        throw std::logic_error("Error when parsing the fen string");
+  throw std::logic_error(std::string("Invalid ") + field +
+                         " in the fen string, at column " + std::to_string(pos + 1));
+}
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief Skip the whitespace after a field. At least one space is required, unless the
+ * field is optional and the string ends there.
+ */
+static void skipSpaces(std::string_view fen, size_t& pos, const char* field)
+{
+  if (pos < fen.size() && !isSpace(fen[pos])) {
+    fenError(field, pos);
+  }
+  while (pos < fen.size() && isSpace(fen[pos])) {
+    ++pos;
+  }
+}
+
+static void parsePlacement(std::string_view fen, size_t& pos, Position& b)
+{
+  // Pieces are found at their index in this string, which matches symbol().
+  static constexpr std::string_view sSymbols = "_pnbrqk__PNBRQK";
+  int                               rank     = 0;
+  int                               file     = 0;
+  for (; pos < fen.size() && !isSpace(fen[pos]); ++pos) {
+    char c = fen[pos];
+    if (c == '/') {
+      if (file != 8 || ++rank > 7) {
+        fenError("piece placement", pos);
       }
-      break;
-    case '1':
-      ++pos;
-      break;
-    case '2':
-      pos += 2;
-      break;
-    case '3':
-      pos += 3;
-      break;
-    case '4':
-      pos += 4;
-      break;
-    case '5':
-      pos += 5;
-      break;
-    case '6':
-      pos += 6;
-      break;
-    case '7':
-      pos += 7;
-      break;
-    case '8':
-      pos += 8;
-      break;
+      file = 0;
+    }
+    else if (c >= '1' && c <= '8') {
+      file += c - '0';
+      if (file > 8) {
+        fenError("piece placement", pos);
+      }
+    }
+    else {
+      size_t pc = sSymbols.find(c);
+      if (c == '_' || pc == std::string_view::npos || file > 7) {
+        fenError("piece placement", pos);
+      }
+      b.put(rank * 8 + file, Piece(pc));
+      ++file;
     }
   }
+  if (rank != 7 || file != 8) {
+    fenError("piece placement", pos);
+  }
 }
 
-static Color parseActiveColor(const SubMatch& rTurn)
+static Color parseActiveColor(std::string_view fen, size_t& pos)
 {
-  if (rTurn.length() != 1) {
-    throw std::logic_error("Invalid active color field in the fen string");
-  }
-  char c = *rTurn.first;
-  if (c == 'w') {
+  if (pos < fen.size() && fen[pos] == 'w') {
+    ++pos;
     return Color::WHT;
   }
-  else if (c == 'b') {
+  else if (pos < fen.size() && fen[pos] == 'b') {
+    ++pos;
     return Color::BLK;
   }
-  else {
-    throw std::logic_error("Invalid active color field in the fen string");
-  }
+  fenError("active color", pos);
 }
 
-static Castle parseCastlingRights(const SubMatch& castling)
+static Castle parseCastlingRights(std::string_view fen, size_t& pos)
 {
-  if (castling.length() > 4 || castling.length() < 1) {
-    throw std::logic_error("Invalid castling rights field in the fen string.");
+  if (pos < fen.size() && fen[pos] == '-') {
+    ++pos;
+    return Castle(0);
   }
-  static constexpr std::array<std::tuple<char, Castle>, 4> sCastlingPos = {{
-    {'K', Castle::W_SHORT},
-    {'Q', Castle::W_LONG},
-    {'k', Castle::B_SHORT},
-    {'q', Castle::B_LONG},
-  }};
-  Castle                                                   rights       = Castle(0);
-  for (auto it = castling.first; it != castling.second; ++it) {
-    char c     = *it;
-    auto match = std::find_if(sCastlingPos.begin(), sCastlingPos.end(), [c](auto tup) {
-      return std::get<0>(tup) == c;
-    });
-    if (match == sCastlingPos.end()) {
-      continue;
+  Castle rights = Castle(0);
+  size_t begin  = pos;
+  for (; pos < fen.size() && !isSpace(fen[pos]); ++pos) {
+    switch (fen[pos]) {
+    case 'K':
+      rights = rights | W_SHORT;
+      break;
+    case 'Q':
+      rights = rights | W_LONG;
+      break;
+    case 'k':
+      rights = rights | B_SHORT;
+      break;
+    case 'q':
+      rights = rights | B_LONG;
+      break;
+    default:
+      fenError("castling rights", pos);
     }
-    rights = Castle(rights | std::get<1>(*match));
+  }
+  if (pos == begin || pos - begin > 4) {
+    fenError("castling rights", begin);
   }
   return rights;
 }
 
-static int8_t parseEnpassant(const SubMatch& enpassant)
+static int8_t parseEnpassant(std::string_view fen, size_t& pos)
 {
-  int enp = -1;
-  if (enpassant.length() > 2 || enpassant.length() < 1) {
-    throw std::logic_error("Invalid enpassant target square field in the fen string");
+  if (pos < fen.size() && fen[pos] == '-') {
+    ++pos;
+    return -1;
   }
-  if (enpassant != "-") {
-    enp = fileToX(*enpassant.first) + 8 * rankToY(*(enpassant.first + 1));
+  if (pos + 1 >= fen.size() || fileToX(fen[pos]) == -1 || rankToY(fen[pos + 1]) == -1) {
+    fenError("enpassant target square", pos);
   }
-  return enp;
+  pos += 2;
+  return int8_t(fileToX(fen[pos - 2]) + 8 * rankToY(fen[pos - 1]));
 }
 
-Position Position::fromFen(const std::string& fen)
+template<typename T>
+static T parseCounter(std::string_view fen, size_t& pos, const char* field)
 {
-  std::smatch results;
-  if (std::regex_search(fen,
-                        results,
-                        std::regex("([p,P,n,N,b,B,r,R,q,Q,k,K,1-8,/]+)\\s"  // placement
-                                   "([b,w])\\s"                             // turn
-                                   "([K,Q,k,q,-]+)\\s"  // Castling rights
-                                   "([a-h,1-8,-]+)\\s"  // Enpassant target squares
-                                   "(\\d+)\\s"          // Half moves
-                                   "(\\d+)"             // Full moves.
-                                   ))) {}
-  else {
-    throw std::runtime_error("Failed to parse the above fen string");
-  }
-  Position board;
-  board.clear();
-  parsePlacement(results[1], board);
-  board.mTurn                          = parseActiveColor(results[2]);
-  board.mState.back().mCastlingRights  = parseCastlingRights(results[3]);
-  board.mState.back().mEnPassantSquare = parseEnpassant(results[4]);
-  board.mState.back().mHalfMoveCount   = std::stoi(results[5]);
-  board.mState.back().mMoveCount       = std::stoi(results[6]);
+  unsigned value = 0;
+  auto [end, err] = std::from_chars(fen.data() + pos, fen.data() + fen.size(), value);
+  if (err != std::errc() || value > std::numeric_limits<T>::max()) {
+    fenError(field, pos);
+  }
+  pos = size_t(end - fen.data());
+  return T(value);
+}
+
+Position Position::fromFen(std::string_view fen)
+{
+  Position board = empty();
+  size_t pos = 0;
+  while (pos < fen.size() && isSpace(fen[pos])) {
+    ++pos;
+  }
+  parsePlacement(fen, pos, board);
+  skipSpaces(fen, pos, "piece placement");
+  board.mTurn = parseActiveColor(fen, pos);
+  skipSpaces(fen, pos, "active color");
+  board.mState.mCastlingRights = parseCastlingRights(fen, pos);
+  skipSpaces(fen, pos, "castling rights");
+  board.mState.mEnPassantSquare = parseEnpassant(fen, pos);
+  skipSpaces(fen, pos, "enpassant target square");
+  // The move counters are optional, so that EPD records can be read. Anything after the
+  // counters, like EPD operations, is ignored.
+  if (pos < fen.size() && fen[pos] >= '0' && fen[pos] <= '9') {
+    board.mState.mHalfMoveCount = parseCounter<uint8_t>(fen, pos, "half move count");
+    skipSpaces(fen, pos, "half move count");
+    board.mState.mMoveCount = parseCounter<uint16_t>(fen, pos, "move count");
+  }
+  board.calcHash();
   return board;
 }
 
-std::string Position::fen() const
+std::string_view Position::fen(FenBuffer& buf) const
 {
-  std::string out;
-  {  // Placement
+  char* out = buf.data();
+  for (int rank = 0; rank < 8; ++rank) {
+    if (rank) {
+      *out++ = '/';
+    }
     int empty = 0;
-    for (size_t pi = 0; pi < mPieces.size(); ++pi) {
-      Piece pc = mPieces[pi];
-      if (pi % 8 == 0) {
-        if (empty) {
-          out += std::to_string(empty);
-          empty = 0;
-        }
-        if (pi) {
-          out.push_back('/');
-        }
-      }
-      if (pc) {
-        if (empty) {
-          out += std::to_string(empty);
-          empty = 0;
-        }
-        out.push_back(symbol(pc));
-      }
-      else {
+    for (int file = 0; file < 8; ++file) {
+      Piece pc = mPieces[rank * 8 + file];
+      if (pc == NONE) {
         ++empty;
+        continue;
+      }
+      if (empty) {
+        *out++ = char('0' + empty);
+        empty  = 0;
       }
+      *out++ = symbol(pc);
     }
     if (empty) {
-      out += std::to_string(empty);
+      *out++ = char('0' + empty);
     }
   }
-  {  // Active turn
-    out += mTurn == BLK ? " b" : " w";
+  *out++ = ' ';
+  *out++ = mTurn == BLK ? 'b' : 'w';
+  *out++ = ' ';
+  if (!mState.mCastlingRights) {
+    *out++ = '-';
   }
-  {  // Castling
-    if (!mState.back().mCastlingRights) {
-      out += " -";
-    }
-    else {
-      static constexpr std::array<char, 4> sSymbols = {{'q', 'k', 'Q', 'K'}};
-      out.push_back(' ');
-      for (int i = 4; i > -1; --i) {
-        if (mState.back().mCastlingRights & (1 << i)) {
-          out.push_back(sSymbols[i]);
-        }
+  else {
+    static constexpr std::array<std::pair<Castle, char>, 4> sSymbols = {
+      {{W_SHORT, 'K'}, {W_LONG, 'Q'}, {B_SHORT, 'k'}, {B_LONG, 'q'}}};
+    for (auto [right, c] : sSymbols) {
+      if (mState.mCastlingRights & right) {
+        *out++ = c;
       }
     }
   }
-  {
-    out.push_back(' ');
-    out += mState.back().mEnPassantSquare == -1
-             ? "-"
-             : SquareCoord[mState.back().mEnPassantSquare];
+  *out++ = ' ';
+  if (mState.mEnPassantSquare == -1) {
+    *out++ = '-';
+  }
+  else {
+    out = std::copy_n(SquareCoord[mState.mEnPassantSquare].data(), 2, out);
   }
-  out += " " + std::to_string(int(mState.back().mHalfMoveCount));
-  out += " " + std::to_string(int(mState.back().mMoveCount));
-  return out;
+  char* end = buf.data() + buf.size();
+  *out++    = ' ';
+  out       = std::to_chars(out, end, int(mState.mHalfMoveCount)).ptr;
+  *out++    = ' ';
+  out       = std::to_chars(out, end, int(mState.mMoveCount)).ptr;
+  return std::string_view(buf.data(), size_t(out - buf.data()));
+}
+
+std::string Position::fen() const
+{
+  FenBuffer buf;
+  return std::string(fen(buf));
 }
 
 void Position::incrementMoveCounter()
 {
-  ++(mState.back().mMoveCount);
+  ++(mState.mMoveCount);
 }
 
 void Position::incrementHalfMoveCount()
 {
-  ++(mState.back().mHalfMoveCount);
+  ++(mState.mHalfMoveCount);
 }
 
 void Position::resetHalfMoveCount()
 {
-  mState.back().mHalfMoveCount = 0;
+  mState.mHalfMoveCount = 0;
 }
 
 void Position::setMoveCount(int c)
 {
-  mState.back().mMoveCount = c;
+  mState.mMoveCount = c;
 }
 
 void Position::setHalfMoveCount(int c)
 {
-  mState.back().mHalfMoveCount = c;
+  mState.mHalfMoveCount = c;
 }
 
 int Position::moveCount() const
 {
-  return mState.back().mMoveCount;
+  return mState.mMoveCount;
 }
 
 int Position::halfMoveCount() const
 {
-  return int(mState.back().mHalfMoveCount);
+  return int(mState.mHalfMoveCount);
+}
+
+/**
+ * @brief Undo records of the positions on this thread. Moves are committed and reverted
+ * in stack order, so the records of a position are always the last ones on the stack.
+ */
+static std::vector<Position::State>& history()
+{
+  thread_local std::vector<Position::State> sHistory = [] {
+    std::vector<Position::State> history;
+    history.reserve(256);
+    return history;
+  }();
+  return sHistory;
+}
+
+uint32_t Position::historyLength() const
+{
+  return mHistoryOwner == this && mHistoryStack == &history() ? mHistoryLength : 0;
 }
 
 void Position::pushState()
 {
-  mState.push_back(mState.back());
+  if (historyLength() == 0) {
+    // Take over the stack, in case this is a copy of a position that has records.
+    mHistoryOwner  = this;
+    mHistoryStack  = &history();
+    mHistoryLength = 0;
+  }
+  history().push_back(mState);
+  ++mHistoryLength;
+  ++mState.mPliesFromNull;
 }
 
 void Position::popState()
 {
-  mState.pop_back();
+  assert(historyLength() > 0 && history().size() >= mHistoryLength);
+  mState = history().back();
+  history().pop_back();
+  --mHistoryLength;
+}
+
+void Position::commitNull()
+{
+  pushState();
+  mState.mCapturedPiece = NONE;
+  mState.mPliesFromNull = 0;
+  unsetEnpassantSq();
+  incrementHalfMoveCount();
+  if (mTurn == BLK) {
+    incrementMoveCounter();
+  }
+  switchTurn();
+}
+
+void Position::revertNull()
+{
+  // The hash comes back with the state, so only the turn needs to be flipped here.
+  mTurn = Color(mTurn ^ WHT);
+  popState();
+}
+
+int Position::reversiblePlies() const
+{
+  // Positions before the last capture, pawn move or null move can't come back. The stack
+  // bound keeps a position whose records were dropped from reading past the bottom.
+  return std::min<int>({mState.mHalfMoveCount,
+                        mState.mPliesFromNull,
+                        int(historyLength()),
+                        int(history().size())});
+}
+
+void Position::detachHistory()
+{
+  // Unlike freezeState, this leaves the stack alone, so the records stay with whichever
+  // position pushed them.
+  mHistoryOwner  = nullptr;
+  mHistoryStack  = nullptr;
+  mHistoryLength = 0;
+}
+
+bool Position::isRepetition() const
+{
+  // A position can repeat at the earliest four plies later.
+  const auto& states = history();
+  assert(states.size() >= historyLength());
+  for (int i = 4; i <= reversiblePlies(); i += 2) {
+    if (states[states.size() - i].mHash == mState.mHash) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Position::isDraw(int ply) const
+{
+  if (mState.mHalfMoveCount >= 100) {
+    return true;  // Fifty-move rule. This ignores a checkmate on the last move.
+  }
+  // A repetition within the search path is scored as a draw straight away, because the
+  // side that could avoid it would have done so. Earlier positions in the game have to
+  // repeat twice, for a threefold repetition.
+  const auto& states  = history();
+  int         repeats = 0;
+  assert(states.size() >= historyLength());
+  for (int i = 4; i <= reversiblePlies(); i += 2) {
+    if (states[states.size() - i].mHash == mState.mHash && (i < ply || ++repeats == 2)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void Position::freezeState()
 {
-  mState[0] = mState.back();
-  mState.resize(1);
+  auto&  states = history();
+  size_t n      = historyLength();
+  assert(states.size() >= n);
+  states.resize(states.size() - std::min(n, states.size()));
+  detachHistory();
 }
 
-void Position::pushCapture(Piece p)
+void Position::setCapturedPiece(Piece p)
 {
-  mCaptured.push_back(p);
+  mState.mCapturedPiece = p;
 }
 
-Piece Position::popCapture()
+Piece Position::capturedPiece() const
 {
-  Piece p = mCaptured.back();
-  mCaptured.pop_back();
-  return p;
+  return mState.mCapturedPiece;
 }
 
 bool Position::valid() const
@@ -10,6 +10,8 @@
 #include <ostream>
 #include <span>
 #include <stack>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace potato {
@@ -125,11 +127,20 @@ public:
     uint8_t  mHalfMoveCount   = 0;
     int8_t   mEnPassantSquare = -1;
     Castle   mCastlingRights  = Castle(0b1111);
+    Piece    mCapturedPiece   = NONE;  // Captured by the move that led to this state.
+    uint16_t mPliesFromNull   = 0;     // Repetition scans stop at null moves.
+    uint64_t mHash            = 0;     // Zobrist key, restored with the state on revert.
+    uint64_t mPawnHash        = 0;     // Zobrist key of the pawns only.
+    uint64_t mMaterialHash    = 0;     // Depends only on the number of each piece.
 
     bool operator==(const State&) const;
     bool operator!=(const State&) const;
   };
 
+  // Long enough for any FEN string written by fen(), with three digit half move counts
+  // and five digit move counts.
+  using FenBuffer = std::array<char, 92>;
+
   Position();
   Position&       put(int pos, Piece pc);
   Position&       put(glm::ivec2 pos, Piece pc);
@@ -141,6 +152,11 @@ public:
   Piece           piece(int pos) const;
   Piece           piece(glm::ivec2 pos) const;
   BitBoard        board(Piece p) const;
+  BitBoard        occupied() const;
+  BitBoard        occupied(Color c) const;
+  BitBoard        attackersTo(int sq, BitBoard occupied) const;
+  BitBoard        attackersTo(Color c, int sq, BitBoard occupied) const;
+  BitBoard        attacks(Color c) const;
   int             enpassantSq() const;
   void            setEnpassantSq(int enp);
   void            unsetEnpassantSq();
@@ -152,6 +168,8 @@ public:
   void            switchTurn();
   void            clear();
   size_t          hash() const;
+  uint64_t        pawnHash() const;
+  uint64_t        materialHash() const;
   int             material() const;
   bool            valid() const;
   std::string     fen() const;
@@ -162,27 +180,46 @@ public:
   void            setHalfMoveCount(int c);
   int             moveCount() const;
   int             halfMoveCount() const;
+  // Undo records are kept on a stack shared by the positions of a thread, so moves must
+  // be committed and reverted in stack order on each thread. Only the position that
+  // pushed the records can see them; copies start without any.
   void            pushState();
   void            popState();
   void            freezeState();
-  void            pushCapture(Piece p);
-  Piece           popCapture();
+  void            detachHistory();
+  void            commitNull();
+  void            revertNull();
+  bool            isRepetition() const;
+  bool            isDraw(int ply) const;
+  void            setCapturedPiece(Piece p);
+  Piece           capturedPiece() const;
   static Position empty();
-  static Position fromFen(const std::string& fen);
+  static Position fromFen(std::string_view fen);
   bool            operator==(const Position& other) const;
   bool            operator!=(const Position& other) const;
 
+  // Writes the FEN string to the buffer without allocating, and returns a view of it.
+  std::string_view fen(FenBuffer& buf) const;
+
 private:
-  void calcHash();
+  void     calcHash();
+  int      reversiblePlies() const;
+  uint32_t historyLength() const;
 
   std::array<Piece, 64>               mPieces;
   std::array<BitBoard, NUniquePieces> mBitBoards;
-  StaticVector<State, 32>             mState;
-  StaticVector<Piece, 64>             mCaptured;
-  size_t                              mHash     = 0;
-  int                                 mMaterial = 0;
-  Color                               mTurn     = Color::WHT;
+  std::array<BitBoard, 2>             mColorBoards;  // Indexed by color >> 3.
+  State                               mState;
+  // The undo records on the stack belong to the position at mHistoryOwner, on the thread
+  // whose stack is mHistoryStack. A copy, or a position on another thread, has none.
+  const Position*                     mHistoryOwner  = nullptr;
+  const void*                         mHistoryStack  = nullptr;
+  uint32_t                            mHistoryLength = 0;
+  int                                 mMaterial      = 0;
+  Color                               mTurn          = Color::WHT;
 };
+static_assert(std::is_trivially_copyable_v<Position>,
+              "Positions are copied as raw bytes, and copies start without undo records");
 
 void      writeBoard(BitBoard b, std::ostream& os);
 Position& currentPosition();
@@ -1,12 +1,17 @@
 #define CATCH_CONFIG_MAIN
+#include <Batch.h>
 #include <Move.h>
+#include <PackedPosition.h>
 #include <Util.h>
 #include <algorithm>
+#include <array>
 #include <bit>
 #include <catch.hpp>
 #include <catch2/catch_all.hpp>
 #include <iostream>
+#include <span>
 #include <stack>
+#include <thread>
 
 using namespace potato;
 
@@ -25,6 +30,43 @@ void doPerftTest(const std::string&      fenstr,
 //   perft(p, 5);
 // }
 
+// Positions whose move trees the tests walk, with castling, enpassant,
+// promotions, pins and checks between them.
+static const std::array<const char*, 4> WalkFens = {{
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+}};
+
+/**
+ * @brief Call check on every position reachable from p in fewer than depth plies. The
+ * check may commit and revert moves, as long as it leaves p as it found it.
+ */
+template<typename F>
+static void walkPositions(Position& p, int depth, F&& check)
+{
+  check(p);
+  if (depth > 1) {
+    MoveList moves;
+    generateMoves(p, moves);
+    for (Move m : moves) {
+      m.commit(p);
+      walkPositions(p, depth - 1, check);
+      m.revert(p);
+    }
+  }
+}
+
+template<typename F>
+static void walkPositions(std::span<const char* const> fens, int depth, F&& check)
+{
+  for (const char* fen : fens) {
+    Position p = Position::fromFen(fen);
+    walkPositions(p, depth, check);
+  }
+}
+
 TEST_CASE("Fen Consistency", "[fen][consistency]")
 {
   SECTION("Case 1")
@@ -53,14 +95,14 @@ TEST_CASE("Fen Consistency", "[fen][consistency]")
   {
     Position p = Position::fromFen(
       "r1bqk2r/ppppbp1p/8/3nB1p1/2B1P3/3P4/PPP2PPP/RN2K1NR w KQkq - 0 8");
-    Move(OTHER | CAPTURE, E5, H8).commit(p);
+    Move(OTHER, E5, H8).commit(p);
     REQUIRE(p.fen() == "r1bqk2B/ppppbp1p/8/3n2p1/2B1P3/3P4/PPP2PPP/RN2K1NR b KQq - 0 8");
   }
   SECTION("Case 5")
   {
     Position p = Position::fromFen(
       "r1bqkb1r/1pp2ppp/2n5/pB1pp3/3Pn3/5N2/PPP2PPP/RNBQ1RK1 w kq - 0 7");
-    Move(OTHER | CAPTURE, B5, C6).commit(p);
+    Move(OTHER, B5, C6).commit(p);
     REQUIRE(p.fen() == "r1bqkb1r/1pp2ppp/2B5/p2pp3/3Pn3/5N2/PPP2PPP/RNBQ1RK1 b kq - 0 7");
   }
   SECTION("Case 6")
@@ -74,14 +116,14 @@ TEST_CASE("Fen Consistency", "[fen][consistency]")
   {
     Position p =
       Position::fromFen("1nq1n3/1P3b1p/p2p2kp/6P1/4pKp1/rP2r3/2N5/1B6 w - - 1 2");
-    Move(CAPTURE | PRC_BSH, B7, C8).commit(p);
+    Move(PRC_BSH, B7, C8).commit(p);
     REQUIRE(p.fen() == "1nB1n3/5b1p/p2p2kp/6P1/4pKp1/rP2r3/2N5/1B6 b - - 0 2");
   }
   SECTION("Case 8")
   {
     Position p = Position::fromFen(
       "rnbqk2r/2ppppbp/1p3np1/p7/1P1P4/P4N2/1BP1PPPP/RN1QKB1R b KQkq - 0 6");
-    Move(CAPTURE | OTHER, A5, B4).commit(p);
+    Move(OTHER, A5, B4).commit(p);
     REQUIRE(p.fen() ==
             "rnbqk2r/2ppppbp/1p3np1/8/1p1P4/P4N2/1BP1PPPP/RN1QKB1R w KQkq - 0 7");
   }
@@ -109,6 +151,125 @@ TEST_CASE("Loading from FEN string", "[fen][parsing][generation]")
   REQUIRE(pfen.fen() == fenstr);
 }
 
+TEST_CASE("FEN parsing errors", "[fen][parsing]")
+{
+  auto errorOf = [](std::string_view fen) -> std::string {
+    try {
+      Position::fromFen(fen);
+    }
+    catch (const std::logic_error& e) {
+      return e.what();
+    }
+    return "";
+  };
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1") ==
+          "Invalid piece placement in the fen string, at column 19");
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1") ==
+          "Invalid piece placement in the fen string, at column 35");
+  REQUIRE(errorOf("rnbqkbnr/ppppxppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1") ==
+          "Invalid piece placement in the fen string, at column 14");
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1") ==
+          "Invalid active color in the fen string, at column 45");
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQxq - 0 1") ==
+          "Invalid castling rights in the fen string, at column 49");
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e9 0 1") ==
+          "Invalid enpassant target square in the fen string, at column 52");
+  REQUIRE(errorOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 300 1") ==
+          "Invalid half move count in the fen string, at column 54");
+
+  SECTION("EPD records")
+  {
+    Position p = Position::fromFen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - bm e4; id \"start\";");
+    REQUIRE(p == Position());
+  }
+
+  SECTION("Writing to a buffer")
+  {
+    std::string         fenstr = "r3k2r/8/8/3pP3/8/8/8/R3K2R w Kq d6 12 345";
+    Position            p      = Position::fromFen(fenstr);
+    Position::FenBuffer buf;
+    REQUIRE(p.fen(buf) == fenstr);
+  }
+}
+
+TEST_CASE("Packed positions", "[packed][fen][io]")
+{
+  std::vector<Position> positions;
+  auto                  collect = [&positions](Position& p) { positions.push_back(p); };
+  // The start position, and the largest counters that fit.
+  walkPositions(std::array {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "4k3/8/8/8/8/8/8/4K3 b - - 255 65535"},
+                2,
+                collect);
+  walkPositions(WalkFens, 3, collect);
+
+  SECTION("Encoding")
+  {
+    for (const auto& p : positions) {
+      Position decoded = PackedPosition::encode(p).decode();
+      REQUIRE(decoded.fen() == p.fen());
+      REQUIRE(decoded == p);
+    }
+    Position full;
+    full.put(D4, W_QEN);
+    REQUIRE_THROWS_AS(PackedPosition::encode(full), std::logic_error);
+  }
+
+  SECTION("Corrupt records")
+  {
+    PackedPosition valid = PackedPosition::encode(positions.front());
+    REQUIRE_NOTHROW(valid.decode());
+    for (uint8_t nibble : {0, 7, 8, 15}) {
+      PackedPosition corrupt = valid;
+      corrupt.mPieces[3]     = uint8_t((corrupt.mPieces[3] & 0xf0) | nibble);
+      REQUIRE_THROWS_AS(corrupt.decode(), std::runtime_error);
+    }
+    for (int8_t sq : {int8_t(-2), int8_t(E4), int8_t(A8), int8_t(64)}) {
+      PackedPosition corrupt   = valid;
+      corrupt.mEnPassantSquare = sq;
+      REQUIRE_THROWS_AS(corrupt.decode(), std::runtime_error);
+    }
+    for (int8_t sq : {int8_t(-1), int8_t(A6), int8_t(H3)}) {
+      PackedPosition ok   = valid;
+      ok.mEnPassantSquare = sq;
+      REQUIRE_NOTHROW(ok.decode());
+    }
+    PackedPosition corrupt  = valid;
+    corrupt.mCastlingRights = 0x10;
+    REQUIRE_THROWS_AS(corrupt.decode(), std::runtime_error);
+    corrupt       = valid;
+    corrupt.mTurn = 1;
+    REQUIRE_THROWS_AS(corrupt.decode(), std::runtime_error);
+  }
+
+  SECTION("Files")
+  {
+    fs::path path = fs::temp_directory_path() / "potato_packed_positions.bin";
+    {
+      PackedWriter writer(path);
+      for (int i = 0; i < 20000; ++i) {  // More than one chunk of the file.
+        writer.write(positions[size_t(i) % positions.size()]);
+      }
+      REQUIRE(writer.size() == 20000);
+    }
+    REQUIRE(fs::file_size(path) == 20000 * sizeof(PackedPosition));
+    {
+      PackedReader reader(path);
+      REQUIRE(reader.size() == 20000);
+      Position p;
+      size_t   i = 0;
+      while (reader.next(p)) {
+        REQUIRE(p.fen() == positions[i % positions.size()].fen());
+        ++i;
+      }
+      REQUIRE(i == 20000);
+      REQUIRE(reader.records()[7].decode() == positions[7]);
+    }
+    fs::remove(path);
+  }
+}
+
 TEST_CASE("Slider move bitboards", "[slider][moves][bitboards]")
 {
   Position p = Position::fromFen("Q1n5/5nb1/6KP/1P2P1p1/1R2p3/q7/b1k4p/1N6 w - - 0 1");
@@ -172,6 +333,78 @@ TEST_CASE("Slider move bitboards", "[slider][moves][bitboards]")
   }
 }
 
+static BitBoard walkRays(int sq, BitBoard blockers, std::span<const glm::ivec2> dirs)
+{
+  BitBoard out = 0;
+  for (glm::ivec2 d : dirs) {
+    int x = sq % 8 + d.x;
+    int y = sq / 8 + d.y;
+    while (x > -1 && x < 8 && y > -1 && y < 8) {
+      out |= OneHot[y * 8 + x];
+      if (blockers & OneHot[y * 8 + x]) {
+        break;
+      }
+      x += d.x;
+      y += d.y;
+    }
+  }
+  return out;
+}
+
+TEST_CASE("Slider lookups", "[slider][moves][bitboards][magic]")
+{
+  static const std::array<glm::ivec2, 4> sDiags  = {{{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+  static const std::array<glm::ivec2, 4> sOrthos = {{{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+  uint64_t                               state   = 0x2545f4914f6cdd1d;
+  auto                                   random  = [&state]() {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  };
+  for (int i = 0; i < 1000; ++i) {
+    BitBoard blockers = random() & random();
+    for (int sq = 0; sq < 64; ++sq) {
+      REQUIRE(bishopMoves(sq, blockers) == walkRays(sq, blockers, sDiags));
+      REQUIRE(rookMoves(sq, blockers) == walkRays(sq, blockers, sOrthos));
+    }
+  }
+}
+
+TEST_CASE("Slider attack fill", "[slider][attacks][bitboards]")
+{
+  uint64_t state  = 0x9e3779b97f4a7c15;
+  auto     random = [&state]() {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  };
+  for (int i = 0; i < 10000; ++i) {
+    BitBoard all      = random() & random();
+    BitBoard diags    = all & random() & random();
+    BitBoard orthos   = all & random() & random();
+    BitBoard expected = 0;
+    for (BitBoard b = diags; b;) {
+      expected |= bishopMoves(pop(b), all);
+    }
+    for (BitBoard b = orthos; b;) {
+      expected |= rookMoves(pop(b), all);
+    }
+    REQUIRE(sliderAttackFill(diags, orthos, ~all) == expected);
+  }
+}
+
+static void checkHashes(const Position& p)
+{
+  Position expected = Position::fromFen(p.fen());
+  REQUIRE(p.hash() == expected.hash());
+  REQUIRE(p.pawnHash() == expected.pawnHash());
+  REQUIRE(p.materialHash() == expected.materialHash());
+}
+
 TEST_CASE("Zobrist Hash Updates", "[zobrist][hash][incremental][update]")
 {
   SECTION("Reversible put / remove")
@@ -226,6 +459,286 @@ TEST_CASE("Zobrist Hash Updates", "[zobrist][hash][incremental][update]")
     REQUIRE(p.valid());
     REQUIRE(h1 == p.hash());
   }
+
+  SECTION("Turn, castling and enpassant")
+  {
+    Position p = Position::fromFen("4k2r/8/8/3pP3/8/8/8/4K2R w Kk d6 0 1");
+    REQUIRE(p.hash() != Position::fromFen("4k2r/8/8/3pP3/8/8/8/4K2R b Kk d6 0 1").hash());
+    REQUIRE(p.hash() != Position::fromFen("4k2r/8/8/3pP3/8/8/8/4K2R w k d6 0 1").hash());
+    REQUIRE(p.hash() != Position::fromFen("4k2r/8/8/3pP3/8/8/8/4K2R w Kk - 0 1").hash());
+    uint64_t h1 = p.hash();
+    p.revokeCastlingRights(W_SHORT);
+    p.unsetEnpassantSq();
+    p.switchTurn();
+    REQUIRE(p.hash() == Position::fromFen("4k2r/8/8/3pP3/8/8/8/4K2R b k - 0 1").hash());
+    p.setCastlingRights(W_SHORT | B_SHORT);
+    p.setEnpassantSq(D6);
+    p.setTurn(WHT);
+    REQUIRE(p.hash() == h1);
+  }
+
+  SECTION("Pawn and material keys")
+  {
+    Position p  = Position::fromFen("4k3/pp6/8/8/8/8/PP6/RN2K3 w - - 0 1");
+    uint64_t h1 = p.pawnHash();
+    uint64_t m1 = p.materialHash();
+    p.move(A1, A8).move(B1, C3);
+    REQUIRE(p.pawnHash() == h1);
+    REQUIRE(p.materialHash() == m1);
+    p.move(A2, A4);
+    REQUIRE(p.pawnHash() != h1);
+    REQUIRE(p.materialHash() == m1);
+    p.remove(C3);
+    REQUIRE(p.materialHash() != m1);
+    REQUIRE(p.materialHash() ==
+            Position::fromFen("4k3/pp6/8/8/8/8/PP6/R3K3 w - - 0 1").materialHash());
+    p.put(H3, W_HRS);
+    REQUIRE(p.materialHash() == m1);
+  }
+
+  SECTION("No-op put and remove")
+  {
+    Position p;
+    p.put(E2, W_PWN);
+    checkHashes(p);
+    p.put(E8, B_KNG);
+    checkHashes(p);
+    p.remove(E4);
+    checkHashes(p);
+    Position empty = Position::empty();
+    empty.remove(E4);
+    checkHashes(empty);
+    empty.put(E4, NONE);
+    checkHashes(empty);
+  }
+
+  SECTION("Incremental updates match a full calculation")
+  {
+    for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+         }) {
+      Position p = Position::fromFen(fen);
+      MoveList moves, replies;
+      generateMoves(p, moves);
+      for (const auto& m : moves) {
+        uint64_t h1 = p.hash();
+        m.commit(p);
+        checkHashes(p);
+        generateMoves(p, replies);
+        for (const auto& r : replies) {
+          r.commit(p);
+          checkHashes(p);
+          r.revert(p);
+        }
+        m.revert(p);
+        REQUIRE(p.hash() == h1);
+      }
+    }
+  }
+}
+
+TEST_CASE("Occupancy boards", "[occupancy][bitboards][incremental]")
+{
+  auto checkOccupancy = [](const Position& p) {
+    BitBoard white = 0, black = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+      Piece pc = p.piece(sq);
+      if (pc != NONE) {
+        (color(pc) == WHT ? white : black) |= OneHot[sq];
+      }
+    }
+    REQUIRE(p.occupied(WHT) == white);
+    REQUIRE(p.occupied(BLK) == black);
+    REQUIRE(p.occupied() == (white | black));
+  };
+  Position p = Position::fromFen(
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+  checkOccupancy(p);
+  MoveList moves, replies;
+  generateMoves(p, moves);
+  for (const auto& m : moves) {
+    m.commit(p);
+    checkOccupancy(p);
+    generateMoves(p, replies);
+    for (const auto& r : replies) {
+      r.commit(p);
+      checkOccupancy(p);
+      r.revert(p);
+    }
+    m.revert(p);
+    checkOccupancy(p);
+  }
+}
+
+TEST_CASE("Deep move history", "[history][commit][revert]")
+{
+  // Shuffle the knights back and forth for more plies than a fixed history would hold.
+  Position            p     = Position::fromFen("4k3/8/8/8/8/8/8/1N2K1n1 w - - 0 1");
+  std::string         fen   = p.fen();
+  std::array<Move, 4> cycle = {
+    {Move(OTHER, B1, C3), Move(OTHER, G1, F3), Move(OTHER, C3, B1), Move(OTHER, F3, G1)}};
+  std::vector<Move>     played;
+  std::vector<uint64_t> hashes;
+  for (int ply = 0; ply < 300; ++ply) {
+    Move m = cycle[ply % 4];
+    hashes.push_back(p.hash());
+    m.commit(p);
+    played.push_back(m);
+  }
+  REQUIRE(p.hash() == hashes[0]);
+  Position copy = p;
+  for (int ply = 299; ply >= 0; --ply) {
+    played[ply].revert(p);
+    REQUIRE(p.hash() == hashes[ply]);
+  }
+  REQUIRE(p.fen() == fen);
+  REQUIRE(copy.moveCount() == 151);
+}
+
+TEST_CASE("Null move", "[null-move][commit][revert]")
+{
+  Position p = Position::fromFen(
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/Pp2P3/2N2Q1p/1PPBBPPP/R3K2R b KQkq a3 0 1");
+  Position before = p;
+  p.commitNull();
+  REQUIRE(p.turn() == WHT);
+  REQUIRE(p.enpassantSq() == -1);
+  REQUIRE(p.fen() ==
+          "r3k2r/p1ppqpb1/bn2pnp1/3PN3/Pp2P3/2N2Q1p/1PPBBPPP/R3K2R w KQkq - 1 2");
+  REQUIRE(p.hash() == Position::fromFen(p.fen()).hash());
+  MoveList moves;
+  generateMoves(p, moves);
+  for (const auto& m : moves) {
+    m.commit(p);
+    p.commitNull();
+    REQUIRE(p.hash() == Position::fromFen(p.fen()).hash());
+    p.revertNull();
+    m.revert(p);
+  }
+  p.revertNull();
+  REQUIRE(p == before);
+  REQUIRE(p.fen() == before.fen());
+}
+
+TEST_CASE("Repetitions and draws", "[history][repetition][draw]")
+{
+  std::array<Move, 4> cycle = {
+    {Move(OTHER, B1, C3), Move(OTHER, G8, F6), Move(OTHER, C3, B1), Move(OTHER, F6, G8)}};
+
+  SECTION("Knight shuffle")
+  {
+    Position p = Position::fromFen("4k1n1/4p3/8/8/8/8/4P3/1N2K3 w - - 0 1");
+    for (int ply = 0; ply < 4; ++ply) {
+      REQUIRE_FALSE(p.isRepetition());
+      cycle[ply % 4].commit(p);
+    }
+    REQUIRE(p.isRepetition());
+    REQUIRE(p.isDraw(5));  // Repeated within the search path.
+    REQUIRE_FALSE(p.isDraw(0));
+    for (int ply = 4; ply < 8; ++ply) {
+      cycle[ply % 4].commit(p);
+    }
+    REQUIRE(p.isDraw(0));  // Threefold repetition.
+    Move(PUSH, E2, E3).commit(p);
+    REQUIRE_FALSE(p.isRepetition());
+    REQUIRE_FALSE(p.isDraw(100));
+  }
+
+  SECTION("Copies don't own the records")
+  {
+    Position p = Position::fromFen("4k1n1/4p3/8/8/8/8/4P3/1N2K3 w - - 0 1");
+    for (const auto& m : cycle) {
+      m.commit(p);
+    }
+    Position copy = p;
+    REQUIRE_FALSE(copy.isRepetition());
+    copy.freezeState();
+    REQUIRE(p.isRepetition());
+    for (auto it = cycle.rbegin(); it != cycle.rend(); ++it) {
+      it->revert(p);
+    }
+    REQUIRE(p == Position::fromFen("4k1n1/4p3/8/8/8/8/4P3/1N2K3 w - - 0 1"));
+  }
+
+  SECTION("Null moves")
+  {
+    Position p = Position::fromFen("4k1n1/4p3/8/8/8/8/4P3/1N2K3 w - - 0 1");
+    cycle[0].commit(p);
+    p.commitNull();
+    cycle[2].commit(p);
+    p.commitNull();
+    REQUIRE_FALSE(p.isRepetition());
+    p.revertNull();
+    cycle[2].revert(p);
+    p.revertNull();
+    cycle[0].revert(p);
+  }
+
+  SECTION("Fifty-move rule")
+  {
+    REQUIRE(Position::fromFen("4k3/8/8/8/8/8/8/1N2K3 w - - 100 80").isDraw(0));
+    REQUIRE_FALSE(Position::fromFen("4k3/8/8/8/8/8/8/1N2K3 w - - 99 80").isDraw(0));
+  }
+}
+
+TEST_CASE("Copy-make", "[commit][copy-make]")
+{
+  for (const char* fen : {
+         "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+         "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+         "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+       }) {
+    Position p      = Position::fromFen(fen);
+    Position before = p;
+    MoveList moves;
+    generateMoves(p, moves);
+    for (const auto& m : moves) {
+      Position next = m.commitCopy(p);
+      REQUIRE(p == before);
+      m.commit(p);
+      REQUIRE(next == p);
+      REQUIRE(next.fen() == p.fen());
+      m.revert(p);
+    }
+  }
+
+  // Reach a repetition, so the original has undo records that copies must not touch.
+  Position p = Position::fromFen("4k1n1/4p3/8/8/8/8/4P3/1N2K3 w - - 0 1");
+  for (Move m : {Move(OTHER, B1, C3),
+                 Move(OTHER, G8, F6),
+                 Move(OTHER, C3, B1),
+                 Move(OTHER, F6, G8)}) {
+    m.commit(p);
+  }
+  REQUIRE(p.isRepetition());
+
+  SECTION("Copy on another thread")
+  {
+    bool     repetition = true;
+    Position next;
+    std::thread([&, copy = p]() mutable {
+      repetition = copy.isRepetition() || copy.isDraw(0);
+      Move(OTHER, B1, C3).commit(copy);
+      Move(OTHER, B1, C3).revert(copy);
+      copy.freezeState();
+      next = Move(OTHER, B1, C3).commitCopy(copy);
+    }).join();
+    REQUIRE_FALSE(repetition);
+    REQUIRE(next == Move(OTHER, B1, C3).commitCopy(p));
+    REQUIRE(p.isRepetition());
+  }
+
+  SECTION("Freezing a copy")
+  {
+    Position copy = p;
+    copy.freezeState();
+    REQUIRE(p.isRepetition());
+    Position next = Move(OTHER, B1, C3).commitCopy(p);
+    next.freezeState();
+    REQUIRE(p.isRepetition());
+  }
 }
 
 TEST_CASE("Material count", "[material][value][incremental]")
@@ -242,10 +755,10 @@ TEST_CASE("Material count", "[material][value][incremental]")
       "r1b2rk1/pp1nqppp/3bpn2/2p5/2BP4/2N1PN1P/PPQ2PP1/R1B2RK1 w - - 0 11");
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
-    Move(OTHER | CAPTURE, D4, C5).commit(p);
+    Move(OTHER, D4, C5).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 1);
-    Move(OTHER | CAPTURE, D6, C5).commit(p);
+    Move(OTHER, D6, C5).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
   }
@@ -255,10 +768,10 @@ TEST_CASE("Material count", "[material][value][incremental]")
       "r1r3k1/1b1nqppp/p2bp3/1p2n3/3BP3/PBN2N1P/1P3PP1/1Q1RR1K1 w - - 10 31");
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
-    Move(OTHER | CAPTURE, F3, E5).commit(p);
+    Move(OTHER, F3, E5).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 3);
-    Move(OTHER | CAPTURE, D7, E5).commit(p);
+    Move(OTHER, D7, E5).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
   }
@@ -268,7 +781,7 @@ TEST_CASE("Material count", "[material][value][incremental]")
       Position::fromFen("r5k1/1b3ppp/p3p3/1pr5/4PP1q/PB1Q3P/1P1nN1P1/2R1R1K1 b - - 3 37");
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
-    Move(OTHER | CAPTURE, D2, E4).commit(p);
+    Move(OTHER, D2, E4).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == -1);
   }
@@ -278,15 +791,342 @@ TEST_CASE("Material count", "[material][value][incremental]")
       Position::fromFen("5k1r/5p2/3pbb2/qp1B4/1Nr4p/P2RQ3/2P3PP/1K1R4 w - - 3 29");
     REQUIRE(p.valid());
     REQUIRE(p.material() == 0);
-    Move(OTHER | CAPTURE, D5, C4).commit(p);
+    Move(OTHER, D5, C4).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 5);
-    Move(OTHER | CAPTURE, B5, C4).commit(p);
+    Move(OTHER, B5, C4).commit(p);
     REQUIRE(p.valid());
     REQUIRE(p.material() == 2);
   }
 }
 
+TEST_CASE("Captures and quiets generation", "[move-gen-types][generation]")
+{
+  walkPositions(WalkFens, 3, [](Position& p) {
+    MoveList all, captures, quiets;
+    bool     inCheck = generateMoves(p, all);
+    REQUIRE(generateMoves<GenType::CAPTURES>(p, captures) == inCheck);
+    REQUIRE(generateMoves<GenType::QUIETS>(p, quiets) == inCheck);
+    REQUIRE(captures.size() + quiets.size() == all.size());
+    auto isCapture = [&p](Move m) { return m.isCapture(p); };
+    REQUIRE(std::all_of(captures.begin(), captures.end(), isCapture));
+    REQUIRE(std::none_of(quiets.begin(), quiets.end(), isCapture));
+    for (Move m : all) {
+      bool found = std::find(captures.begin(), captures.end(), m) != captures.end() ||
+                   std::find(quiets.begin(), quiets.end(), m) != quiets.end();
+      REQUIRE(found);
+    }
+  });
+}
+
+TEST_CASE("Move counting", "[move-gen-types][counting]")
+{
+  walkPositions(WalkFens, 3, [](Position& p) {
+    MoveList all, captures, quiets;
+    generateMoves(p, all);
+    generateMoves<GenType::CAPTURES>(p, captures);
+    generateMoves<GenType::QUIETS>(p, quiets);
+    REQUIRE(countMoves(p) == all.size());
+    REQUIRE(countMoves<GenType::CAPTURES>(p) == captures.size());
+    REQUIRE(countMoves<GenType::QUIETS>(p) == quiets.size());
+  });
+}
+
+TEST_CASE("Batched generation", "[batch][generation][counting]")
+{
+  std::vector<Position> positions;
+  walkPositions(WalkFens, 2, [&positions](Position& p) { positions.push_back(p); });
+  for (size_t nThreads : {1, 3, 8}) {
+    BatchMoves          batch;
+    std::vector<size_t> counts(positions.size());
+    generateMoves(positions, batch, nThreads);
+    countMoves(positions, counts, nThreads);
+    REQUIRE(batch.size() == positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      MoveList moves;
+      generateMoves(positions[i], moves);
+      auto batchMoves = batch.moves(i);
+      REQUIRE(
+        std::equal(moves.begin(), moves.end(), batchMoves.begin(), batchMoves.end()));
+      REQUIRE(counts[i] == moves.size());
+    }
+  }
+}
+
+TEST_CASE("Quiet checks generation", "[move-gen-types][generation][checks]")
+{
+  auto check = [](Position& p) {
+    MoveList all, quiets, checks;
+    bool     inCheck = generateMoves(p, all);
+    REQUIRE(generateMoves<GenType::QUIET_CHECKS>(p, checks) == inCheck);
+    generateMoves<GenType::QUIETS>(p, quiets);
+    size_t expected = 0;
+    for (Move m : quiets) {
+      m.commit(p);
+      MoveList replies;
+      bool     givesCheck = generateMoves(p, replies);
+      m.revert(p);
+      if (givesCheck) {
+        ++expected;
+        REQUIRE(std::count(checks.begin(), checks.end(), m) == 1);
+      }
+    }
+    REQUIRE(checks.size() == expected);
+  };
+  walkPositions(WalkFens, 3, check);
+  // Discovered checks by pawns, knights and the king, and a castling check.
+  walkPositions(std::array {"5k2/8/8/1B6/2P5/3N4/4K3/R3R3 w - - 0 1",
+                            "3k4/8/8/8/8/8/8/R3K2R w KQ - 0 1"},
+                3,
+                check);
+}
+
+TEST_CASE("Gives check", "[checks][gives-check]")
+{
+  auto check = [](Position& p) {
+    MoveList  legal;
+    CheckInfo ci = CheckInfo::fromPosition(p);
+    generateMoves(p, legal);
+    for (Move m : legal) {
+      bool expected = givesCheck(p, m, ci);
+      m.commit(p);
+      MoveList replies;
+      REQUIRE(generateMoves(p, replies) == expected);
+      m.revert(p);
+    }
+  };
+  walkPositions(WalkFens, 3, check);
+  // Enpassant that discovers a check on the rank of the captured pawn.
+  walkPositions(std::array {"8/8/8/1k1pP2R/8/8/8/4K3 w - d6 0 1",
+                            "5k2/8/8/1B6/2P5/3N4/4K3/R3R3 w - - 0 1",
+                            "3k4/8/8/8/8/8/8/R3K2R w KQ - 0 1"},
+                3,
+                check);
+}
+
+TEST_CASE("Pseudo-legal generation", "[pseudo-legal][generation]")
+{
+  walkPositions(WalkFens, 3, [](Position& p) {
+    MoveList legal, pseudo;
+    bool     inCheck = generateMoves(p, legal);
+    REQUIRE(generatePseudoLegalMoves<GenType::ALL>(p, pseudo) == inCheck);
+    size_t nLegal = 0;
+    for (Move m : pseudo) {
+      if (isLegal(p, m, inCheck)) {
+        ++nLegal;
+        REQUIRE(std::count(legal.begin(), legal.end(), m) == 1);
+      }
+      REQUIRE(isLegal(p, m) == isLegal(p, m, inCheck));
+    }
+    REQUIRE(nLegal == legal.size());
+  });
+}
+
+TEST_CASE("Move validation", "[pseudo-legal][validation]")
+{
+  // Every move is tried in each position, so only the roots are checked.
+  auto check = [](Position& p) {
+    MoveList legal, pseudo;
+    generateMoves(p, legal);
+    generatePseudoLegalMoves<GenType::ALL>(p, pseudo);
+    // Every combination of type and squares, including the ones that make no sense.
+    for (int t = 0; t <= OTHER; ++t) {
+      for (int from = 0; from < 64; ++from) {
+        for (int to = 0; to < 64; ++to) {
+          Move m(MoveType(t), from, to);
+          bool isPseudo = std::find(pseudo.begin(), pseudo.end(), m) != pseudo.end();
+          bool isLegalMove = std::find(legal.begin(), legal.end(), m) != legal.end();
+          REQUIRE(isPseudoLegal(p, m) == isPseudo);
+          REQUIRE((isPseudo && isLegal(p, m)) == isLegalMove);
+        }
+      }
+    }
+    REQUIRE_FALSE(isPseudoLegal(p, Move()));
+  };
+  walkPositions(WalkFens, 1, check);
+  // A position with an enpassant capture.
+  std::array<const char*, 1> enpassant = {
+    {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3"}};
+  walkPositions(enpassant, 1, check);
+}
+
+TEST_CASE("Static exchange evaluation", "[see][ordering]")
+{
+  SECTION("Undefended pawn")
+  {
+    Position p = Position::fromFen("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1");
+    Move     m(MV_ROK, E1, E5);
+    REQUIRE(seeGE(p, m, 1));
+    REQUIRE_FALSE(seeGE(p, m, 2));
+  }
+  SECTION("X-ray attackers on both sides")
+  {
+    // NxP, NxN, RxN, BxR, QxB, QxQ. Black comes out a knight for a pawn ahead.
+    Position p =
+      Position::fromFen("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1");
+    Move m(OTHER, D3, E5);
+    REQUIRE(seeGE(p, m, -2));
+    REQUIRE_FALSE(seeGE(p, m, -1));
+  }
+  SECTION("Quiet moves")
+  {
+    Position p =
+      Position::fromFen("rnbqkbnr/pppp1ppp/8/4p3/8/5N2/PPPPPPPP/RNBQKB1R w KQkq - 0 2");
+    REQUIRE(seeGE(p, Move(OTHER, B1, C3), 0));
+    REQUIRE_FALSE(seeGE(p, Move(OTHER, F3, G5), 0));  // Hangs the knight.
+    REQUIRE(seeGE(p, Move(OTHER, F3, E5), 1));
+  }
+  SECTION("Enpassant and promotions")
+  {
+    Position p = Position::fromFen("4k3/1P6/8/3pP3/8/8/8/4K3 w - d6 0 1");
+    REQUIRE(seeGE(p, Move(ENPASSANT, E5, D6), 1));
+    REQUIRE(seeGE(p, Move(PRM_QEN, B7, B8), 8));
+    REQUIRE_FALSE(seeGE(p, Move(PRM_QEN, B7, B8), 9));
+  }
+}
+
+TEST_CASE("Attack queries", "[attacks][bitboards]")
+{
+  walkPositions(WalkFens, 2, [](Position& p) {
+    BitBoard all = p.occupied();
+    for (Color c : {WHT, BLK}) {
+      BitBoard attacked = 0;
+      for (int sq = 0; sq < 64; ++sq) {
+        BitBoard attackers = p.attackersTo(c, sq, all);
+        // Every piece of the color must attack the square according to its own moves.
+        for (BitBoard b = attackers; b;) {
+          int   pos = pop(b);
+          Piece pc  = p.piece(pos);
+          REQUIRE(color(pc) == c);
+          switch (type(pc)) {
+          case PWN:
+            REQUIRE((pawnAttacks(c, OneHot[pos]) & OneHot[sq]));
+            break;
+          case HRS:
+            REQUIRE((KnightMoves[pos] & OneHot[sq]));
+            break;
+          case BSH:
+            REQUIRE((bishopMoves(pos, all) & OneHot[sq]));
+            break;
+          case ROK:
+            REQUIRE((rookMoves(pos, all) & OneHot[sq]));
+            break;
+          case QEN:
+            REQUIRE((queenMoves(pos, all) & OneHot[sq]));
+            break;
+          case KNG:
+            REQUIRE((KingMoves[pos] & OneHot[sq]));
+            break;
+          default:
+            FAIL("Not a piece");
+          }
+        }
+        if (attackers) {
+          attacked |= OneHot[sq];
+        }
+      }
+      REQUIRE(p.attacks(c) == attacked);
+    }
+    for (int sq = 0; sq < 64; ++sq) {
+      REQUIRE(p.attackersTo(sq, all) ==
+              (p.attackersTo(WHT, sq, all) | p.attackersTo(BLK, sq, all)));
+    }
+  });
+}
+
+TEST_CASE("Move generation info", "[generation][attacks][pins]")
+{
+  walkPositions(WalkFens, 3, [](Position& p) {
+    MoveList    moves, expectedMoves;
+    MoveGenInfo info;
+    REQUIRE(generateMoves(p, moves, info) == generateMoves(p, expectedMoves));
+    REQUIRE(moves.size() == expectedMoves.size());
+    Color    enemy   = p.turn() == WHT ? BLK : WHT;
+    BitBoard king    = p.board(p.turn() | KNG);
+    int      kingPos = lsb(king);
+    BitBoard all     = p.occupied();
+    BitBoard self    = all & ~(p.board(enemy | PWN) | p.board(enemy | HRS) |
+                            p.board(enemy | BSH) | p.board(enemy | ROK) |
+                            p.board(enemy | QEN) | p.board(enemy | KNG));
+    BitBoard unsafe  = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+      if (p.attackersTo(enemy, sq, all ^ king)) {
+        unsafe |= OneHot[sq];
+      }
+    }
+    REQUIRE(info.mUnsafe == unsafe);
+    REQUIRE(info.mUnsafe == (info.mPawnAttacks | info.mKnightAttacks |
+                             info.mDiagonalAttacks | info.mOrthogonalAttacks |
+                             info.mKingAttacks));
+    REQUIRE(info.mPawnAttacks == pawnAttacks(enemy, p.board(enemy | PWN)));
+    REQUIRE(info.mKingAttacks == KingMoves[lsb(p.board(enemy | KNG))]);
+    BitBoard checkers = p.attackersTo(enemy, kingPos, all);
+    REQUIRE(info.mCheckers == checkers);
+    BitBoard pinned = 0;
+    for (BitBoard b = self & ~king; b;) {
+      int pos = pop(b);
+      if (p.attackersTo(enemy, kingPos, all ^ OneHot[pos]) & ~checkers) {
+        pinned |= OneHot[pos];
+      }
+    }
+    REQUIRE(info.mPinned == pinned);
+  });
+}
+
+TEST_CASE("Move picker", "[move-picker][ordering]")
+{
+  Position p = Position::fromFen(
+    "r1bqk2r/ppp2ppp/2n5/1B1pp3/3Pn3/b1N2N2/PPP2PPP/R1BQ1RK1 w kq - 0 7");
+  MoveList legal;
+  generateMoves(p, legal);
+  SECTION("Same moves as the generator, captures first")
+  {
+    MovePicker        picker(p);
+    std::vector<Move> picked;
+    Move              m;
+    while (picker.next(m)) {
+      picked.push_back(m);
+    }
+    REQUIRE(picked.size() == legal.size());
+    for (Move lm : legal) {
+      REQUIRE(std::count(picked.begin(), picked.end(), lm) == 1);
+    }
+    auto firstQuiet = std::find_if(
+      picked.begin(), picked.end(), [&p](Move mv) { return !mv.isCapture(p); });
+    REQUIRE(std::none_of(
+      firstQuiet, picked.end(), [&p](Move mv) { return mv.isCapture(p); }));
+    // Most valuable victim first, then the least valuable attacker.
+    REQUIRE(std::distance(picked.begin(), firstQuiet) > 3);
+    REQUIRE(picked[0] == Move(OTHER, B2, A3));
+    REQUIRE(picked[1] == Move(OTHER, C3, E4));
+    REQUIRE(p.piece(picked[2].to()) == B_HRS);
+    REQUIRE(p.piece(picked[3].to()) == B_PWN);
+  }
+  SECTION("Hash move first, without duplicates")
+  {
+    Move              hashMove(OTHER, D1, D3);
+    MovePicker        picker(p, hashMove);
+    std::vector<Move> picked;
+    Move              m;
+    while (picker.next(m)) {
+      picked.push_back(m);
+    }
+    REQUIRE(picked.size() == legal.size());
+    REQUIRE(picked.front() == hashMove);
+    REQUIRE(std::count(picked.begin(), picked.end(), hashMove) == 1);
+  }
+  SECTION("Illegal hash move is ignored")
+  {
+    MovePicker picker(p, Move(OTHER, D1, D5));
+    Move       m;
+    size_t     count = 0;
+    while (picker.next(m)) {
+      ++count;
+    }
+    REQUIRE(count == legal.size());
+  }
+}
+
 TEST_CASE("Best Move", "[bestmove]")
 {
   Position p =
@@ -610,7 +610,6 @@ void game(bool asBlack, bool flipBoard)
           response.mMove->commit(currentPosition());
           update(*(response.mMove));
           response = Response::none();
-          currentPosition().freezeState();
         }
         else if (response.mConclusion == Conclusion::CHECKMATE) {
           std::cout << "It's a checkmate!\n";
@@ -1,4 +1,6 @@
 """Generate the C++ lookup tables."""
+import random
+import sys
 from datetime import datetime
 
 BitBoard = "BitBoard"
@@ -6,6 +8,68 @@ BitBoard = "BitBoard"
 # These only need to be enabled while debugging.
 ENABLE_COMMENTS = False
 
+MASK64 = (1 << 64) - 1
+
+BISHOP_DIRS = [(1, 1), (1, -1), (-1, 1), (-1, -1)]
+ROOK_DIRS = [(1, 0), (-1, 0), (0, 1), (0, -1)]
+
+# Magic numbers for the fancy magic bitboard slider lookups. These were found with
+# findMagic(..., random.Random(MAGIC_SEED)). Searching for them takes a while in python,
+# so they're cached here. Each one is verified before use, and a new one is searched
+# for if the verification fails.
+MAGIC_SEED = 0x5eed
+
+BISHOP_MAGICS = [
+    0x408308400802201, 0x8103100106118000, 0x10041651433102,
+    0x4240094000004, 0x30011040410c1008, 0x18220820420820,
+    0x5284020805042012, 0x480420210024203, 0x850886101021204,
+    0x62442802240020, 0x220121086120100, 0x4082080200008,
+    0x1002220210046800, 0x20810422414800, 0x400005f08201040,
+    0x8903602101400, 0x8050010a02d00400, 0x101000aa82480305,
+    0x8008000102040011, 0x1000880802004080, 0x9000190400002,
+    0x1001801901414010, 0x821000080882000, 0x6042041900420208,
+    0x450089004e00400, 0xc01040048100460, 0x640405008020046,
+    0x324080100220040, 0x4112001102005000, 0x9008004108090800,
+    0x1401020021080101, 0x58400200105210a, 0x2050082208041c84,
+    0x84014800043001, 0x200209000080020, 0x6820080080080,
+    0x409020400020500, 0x105a0200002082, 0x2002120049040400,
+    0xa088820030408, 0x488541000c009, 0x4284a0211182008,
+    0x2001044240800, 0x8000112015020807, 0x488c020204109202,
+    0x82100502020109, 0x4410010104210101, 0x8080910400020,
+    0x2020880808842280, 0x82a004a02308900, 0x54010088040000,
+    0x2490042022420, 0x812004008220000, 0x110102021010104,
+    0xd0451004024000, 0xcc4011204010a22, 0x1409840100822110,
+    0x31805200900804, 0x340400232051004, 0x30c008818842402,
+    0x300000008208844, 0x80000c0810019203, 0xa0910441080200,
+    0x92c0100102008010,
+]
+
+
+ROOK_MAGICS = [
+    0x8d80004004302480, 0x440001000402000, 0x3480200289100080,
+    0x480100208008004, 0x280080180040002, 0x600100600040831,
+    0x400300401084082, 0x1a00020040810024, 0x82002080420101,
+    0x202002080410200, 0x210801000200882, 0x2408801000080080,
+    0x5090800800840080, 0x222000488908200, 0x4001002080104,
+    0xc20800080005900, 0x924380800820c011, 0x40484010002000,
+    0x20008020801000, 0x1020808010000804, 0x402850008009100,
+    0x8054008002008004, 0x400004005f100802, 0xc65a0004164a81,
+    0xc00408200210200, 0x41002c240002000, 0x20004100210010,
+    0x600100080080082, 0xc208008880040080, 0x400020080040080,
+    0xe000420400614810, 0x20008200104104, 0x800804000800038,
+    0x290002008400048, 0x2080200282801000, 0xc1600100a004120,
+    0xc100800800800402, 0x4a0020080800400, 0x208480184000210,
+    0x1801010082000044, 0x1000400080008024, 0x100120100040c000,
+    0xa025002002450010, 0xc240080010008080, 0x842b010801050010,
+    0x80040002008080, 0x40821001840008, 0x412040920004,
+    0x421400680002480, 0x100400080200080, 0x18801042002200,
+    0x800480080100280, 0x685800402080080, 0x89008400020900,
+    0x5044302802018400, 0x200005084110200, 0x20310080012441,
+    0x204104120086, 0x4010800a2202, 0x2002082010000501,
+    0x2006010440882, 0x8002004150381402, 0x50004a502181004,
+    0xc200002081004402,
+]
+
 
 class Board:
     """Represents a bit board."""
@@ -97,6 +161,14 @@ def print2dBoardArray(boards, name):
     print("}};")
 
 
+def printIntArray(values, typename, name, perLine=4):
+    """Print the integers as a constexpr array."""
+    print(f"static constexpr std::array<{typename}, {len(values)}> {name} = {{{{")
+    for i in range(0, len(values), perLine):
+        print(", ".join(hex(v) for v in values[i:i + perLine]) + ",")
+    print("}};")
+
+
 def isOnBoard(x, y):
     """Check if a square is on the board."""
     return (x > -1 and x < 8 and y > -1 and y < 8)
@@ -291,6 +363,93 @@ def castleSafeMask():
     return b
 
 
+def sliderMask(x, y, dirs):
+    """Get the relevant occupancy mask of a slider, i.e. its rays without the edges."""
+    mask = 0
+    for dx, dy in dirs:
+        i, j = x + dx, y + dy
+        while isOnBoard(i + dx, j + dy):
+            mask |= 1 << (i + 8 * j)
+            i += dx
+            j += dy
+    return mask
+
+
+def sliderAttacks(x, y, dirs, occupancy):
+    """Get the squares attacked by a slider, given the occupancy of the board."""
+    attacks = 0
+    for dx, dy in dirs:
+        i, j = x + dx, y + dy
+        while isOnBoard(i, j):
+            bit = 1 << (i + 8 * j)
+            attacks |= bit
+            if occupancy & bit:
+                break
+            i += dx
+            j += dy
+    return attacks
+
+
+def subsets(mask):
+    """Iterate over all subsets of the bits in the mask (Carry-Rippler)."""
+    sub = 0
+    while True:
+        yield sub
+        sub = (sub - mask) & mask
+        if sub == 0:
+            break
+
+
+def magicIndex(occupancy, magic, shift):
+    """Index into the attack table of a square."""
+    return ((occupancy * magic) & MASK64) >> shift
+
+
+def fillMagicTable(occupancies, attacks, magic, shift):
+    """Get the attack table for the magic, or None if the magic has collisions."""
+    table = [None] * (1 << (64 - shift))
+    for occ, atk in zip(occupancies, attacks):
+        idx = magicIndex(occ, magic, shift)
+        if table[idx] is None:
+            table[idx] = atk
+        elif table[idx] != atk:
+            return None
+    return table
+
+
+def findMagic(mask, occupancies, attacks, shift, rng):
+    """Search for a magic number that maps the occupancies without collisions."""
+    while True:
+        # Sparse random numbers make better magic candidates.
+        magic = rng.getrandbits(64) & rng.getrandbits(64) & rng.getrandbits(64)
+        if bin((mask * magic) & 0xFF00000000000000).count('1') < 6:
+            continue
+        if fillMagicTable(occupancies, attacks, magic, shift) is not None:
+            return magic
+
+
+def magicTables(dirs, cachedMagics, offset, rng):
+    """Get the masks, magics, shifts, offsets and the packed attack table."""
+    masks, magics, shifts, offsets, attacks = [], [], [], [], []
+    for sq in range(64):
+        x, y = sq % 8, sq // 8
+        mask = sliderMask(x, y, dirs)
+        shift = 64 - bin(mask).count('1')
+        occs = list(subsets(mask))
+        atks = [sliderAttacks(x, y, dirs, occ) for occ in occs]
+        magic = cachedMagics[sq]
+        table = fillMagicTable(occs, atks, magic, shift)
+        if table is None:
+            magic = findMagic(mask, occs, atks, shift, rng)
+            table = fillMagicTable(occs, atks, magic, shift)
+        masks.append(mask)
+        magics.append(magic)
+        shifts.append(shift)
+        offsets.append(offset + len(attacks))
+        attacks.extend(table)
+    return masks, magics, shifts, offsets, attacks
+
+
 def table(mapfn):
     """Get a table mapping positions to tables."""
     boards = []
@@ -310,11 +469,24 @@ def table2d(mapfn):
     return tbl
 
 
-def printAllTables():
-    """Print all the lookup tables."""
+def printGeneratedNotice():
+    """Print the comment at the top of the generated files."""
     print("/*\nThis file is auto generated.\n"
           "DO NOT EDIT or track this file with git.\nGenerated at: "
           f"{datetime.now()}.\n*/\n")
+
+
+def sliderTables():
+    """Get the magic tables of the bishops and the rooks, which share one attack table."""
+    rng = random.Random(MAGIC_SEED)
+    bishops = magicTables(BISHOP_DIRS, BISHOP_MAGICS, 0, rng)
+    rooks = magicTables(ROOK_DIRS, ROOK_MAGICS, len(bishops[4]), rng)
+    return bishops, rooks
+
+
+def printAllTables():
+    """Print all the lookup tables."""
+    printGeneratedNotice()
     print('#pragma once\n')
     print('#include <array>\n')
     print('#include <stdint.h>\n')
@@ -347,8 +519,49 @@ def printAllTables():
     printBoardArray(castleEmptyMasks(), "CastleEmptyMask")
     print("")
     printBoardArray(castleSafeMask(), "CastleSafeMask")
+    print("")
+    bishops, rooks = sliderTables()
+    bmasks, bmagics, bshifts, boffsets, battacks = bishops
+    rmasks, rmagics, rshifts, roffsets, rattacks = rooks
+    printIntArray(bmasks, BitBoard, "BishopMasks")
+    print("")
+    printIntArray(bmagics, "uint64_t", "BishopMagics")
+    print("")
+    printIntArray(bshifts, "uint8_t", "BishopShifts", 16)
+    print("")
+    printIntArray(boffsets, "uint32_t", "BishopOffsets", 8)
+    print("")
+    printIntArray(rmasks, BitBoard, "RookMasks")
+    print("")
+    printIntArray(rmagics, "uint64_t", "RookMagics")
+    print("")
+    printIntArray(rshifts, "uint8_t", "RookShifts", 16)
+    print("")
+    printIntArray(roffsets, "uint32_t", "RookOffsets", 8)
+    print("")
+    # The attack table is too big to compile in every file that includes this header, so
+    # it is defined in SliderTables.cpp instead.
+    print(f"extern const std::array<{BitBoard}, {len(battacks) + len(rattacks)}> "
+          "SliderAttacks;")
+    print('\n} // namespace potato')
+
+
+def printSliderAttacks():
+    """Print the source file that defines the slider attack table."""
+    bishops, rooks = sliderTables()
+    attacks = bishops[4] + rooks[4]
+    printGeneratedNotice()
+    print('#include <Tables.h>\n')
+    print('namespace potato {\n')
+    print(f"extern const std::array<{BitBoard}, {len(attacks)}> SliderAttacks = {{{{")
+    for i in range(0, len(attacks), 4):
+        print(", ".join(hex(v) for v in attacks[i:i + 4]) + ",")
+    print("}};")
     print('\n} // namespace potato')
 
 
 if __name__ == "__main__":
-    printAllTables()
+    if sys.argv[1:] == ["--slider-attacks"]:
+        printSliderAttacks()
+    else:
+        printAllTables()